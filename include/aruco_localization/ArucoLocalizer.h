@@ -17,9 +17,37 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <aruco_localization/MarkerMeasurement.h>
 #include <aruco_localization/MarkerMeasurementArray.h>
+#include <aruco_localization/MarkerPatchArray.h>
+#include <aruco_localization/LocalizerStats.h>
+#include <aruco_localization/UpdateMarkerMap.h>
+#include <aruco_localization/MarkerMeasurementStamped.h>
+#include <aruco_localization/MarkerCornersArray.h>
+#include <aruco_localization/MarkerMapEstimate.h>
 #include <std_srvs/Trigger.h>
 
+#include <condition_variable>
 #include <experimental/filesystem>
+#include <mutex>
+#include <thread>
+
+#include "aruco_localization/FrameQuality.h"
+#include "aruco_localization/ToneMapper.h"
+#include "aruco_localization/PoseDisambiguator.h"
+#include "aruco_localization/SubMapManager.h"
+#include "aruco_localization/NestedMarkerDetector.h"
+#include "aruco_localization/PerfCounters.h"
+#include "aruco_localization/GridDecoder.h"
+#include "aruco_localization/DeadBand.h"
+#include "aruco_localization/Executor.h"
+#include "aruco_localization/BandPreprocessor.h"
+#include "aruco_localization/FrameRing.h"
+#include "aruco_localization/BlackBox.h"
+#include "aruco_localization/LiveMarkerMap.h"
+#include "aruco_localization/MarkerMapper.h"
+#include "aruco_localization/OrderedPool.h"
+#include "aruco_localization/DetectorBackend.h"
+#include "aruco_localization/Detections.h"
+#include "aruco_localization/SpscQueue.h"
 
 namespace aruco_localizer {
 
@@ -27,6 +55,7 @@ namespace aruco_localizer {
     {
     public:
         ArucoLocalizer();
+        ~ArucoLocalizer();
 
     private:
         // ROS node handles
@@ -38,25 +67,213 @@ namespace aruco_localizer {
         image_transport::CameraSubscriber image_sub_;
         image_transport::Publisher image_pub_;
 
-        // ROS tf listener and broadcaster
-        tf::TransformListener tf_listener_;
+        // Alternatively, frames are read zero-copy from a shared memory ring
+        // (on their own thread), with the camera info coming from ROS
+        ros::Subscriber cinfo_sub_;
+        std::string frameRingName_;
+        FrameRing frameRing_;
+        std::thread frameRingThread_;
+        std::atomic<bool> stopFrameRing_;
+        std::atomic<uint64_t> framesDropped_;   // by the ring thread, for the stats
+        sensor_msgs::CameraInfoConstPtr cinfo_;
+        std::mutex cinfoMutex_;
+
+        // ROS tf broadcaster. A tf listener is only created while calibrating
+        // the attitude, so that `/tf` is not buffered for the node's lifetime.
         tf::TransformBroadcaster tf_br_;
 
+        // how long to wait for the body attitude when calibrating
+        double attitudeTimeout_;
+
         // Bias for the roll and pitch components of camera to body
         tf::Quaternion quat_att_bias_;
 
         // ROS publishers and subscribers
         ros::Publisher estimate_pub_;
+        ros::Publisher estimate_seq_pub_;
         ros::Publisher meas_pub_;
+        ros::Publisher patch_pub_;
+        ros::Publisher stats_pub_;
+
+        // Streaming outputs, published as soon as they are known and tagged
+        // with the sequence number of their frame (as is `estimate`, on `estimate_seq`)
+        bool streamMeasurements_;
+        ros::Publisher corners_pub_;
+        ros::Publisher marker_pub_;
+        uint64_t framesIn_;     // frames received
+        uint64_t frameSeq_;     // sequence number of the frame being finished
         ros::ServiceServer calib_attitude_;
+        ros::ServiceServer dump_blackbox_;
+        ros::ServiceServer update_map_;
+        ros::ServiceServer save_map_;
+        ros::Publisher map_pub_;
 
         // ArUco Map Detector
         double markerSize_;
-        aruco::MarkerMap mmConfig_;
-        aruco::MarkerDetector mDetector_;
+        LiveMarkerMap mmConfig_;
+        LiveMarkerMap::StatePtr mapState_;    // snapshot of the map for the current frame
+        uint64_t trackerMapVersion_;          // version of the map that the tracker was set up with
+        std::unique_ptr<DetectorBackend> detector_;
+        std::string detectorBackend_;
+        DetectorBackend::Options detectorOptions_;
+
+        // Coarse-to-fine detection of nested marker layouts, if any are configured
+        NestedMarkerDetector nestedDetector_;
         aruco::MarkerMapPoseTracker mmPoseTracker_;
         aruco::CameraParameters camParams_;
 
+        // Builds the marker map from the live stream (mapping mode)
+        bool mapping_;
+        MarkerMapper mapper_;
+        std::mutex mapperMutex_;
+        std::vector<MarkerMapper::Observation> mapObservations_;
+        std::string mapDictionary_;
+        std::string mappingOutput_;
+        int mappingPublishPeriod_;
+        uint64_t mappingFrames_;
+        uint64_t mappingRebuildFrame_;      // when the tracker last got the whole map (0: never)
+
+        // Zones of a partitioned marker map, used instead of `mmConfig_` if enabled
+        SubMapManager subMaps_;
+
+        // Chooses between the two planar pose solutions of each marker
+        PoseDisambiguator poseDisambiguator_;
+
+        // Per-marker work runs on the executor shared by the whole process,
+        // prioritized by the deadline of the frame it belongs to
+        Executor* executor_;
+        Executor::Clock::duration frameBudget_;
+        std::vector<PoseDisambiguator::Candidates> candidates_;
+
+        // Tone mapping of high-bit-depth (mono12/mono16) input to 8 bit gray
+        ToneMapper toneMapper_;
+
+        // Only publish poses that changed (or every so often) if enabled
+        bool deadBandEnabled_;
+        DeadBand measDeadBand_;
+        DeadBand estimateDeadBand_;
+        std::vector<DeadBand::Pose> deadBandPoses_;
+
+        // Recent frames and detections, dumped when something goes wrong
+        BlackBox blackBox_;
+        bool blackBoxOnLoss_;
+        double blackBoxJump_;
+        bool wasTracked_;
+        cv::Mat lastTvec_;
+
+        // Sorted IDs of the markers seen in the current and the previous frame.
+        // A change of the set of markers is always published.
+        std::vector<int> markerIds_;
+        std::vector<int> lastMarkerIds_;
+        bool markerSetChanged_;
+
+        // Fused, band-wise conversion to gray and sampling of the frame. If
+        // enabled, detection runs on the gray frame and the quality check on
+        // the sampled one.
+        bool bandPreprocessing_;
+        BandPreprocessor preprocessor_;
+
+        // Pre-detection frame quality check
+        bool qualityCheck_;
+        FrameQuality frameQuality_;
+
+        // One frame on its way through the pipeline
+        struct FrameJob {
+            uint64_t seq;
+            cv_bridge::CvImagePtr image;
+            sensor_msgs::CameraInfoConstPtr cinfo;
+            cv::Mat gray;                       // band preprocessing
+            cv::Mat sampled;
+            bool detected;                      // the quality check and detection ran
+            FrameQuality::Verdict verdict;
+            double sharpness;
+            double brightness;
+            std::vector<aruco::Marker> markers; // as detected, for the ArUco trackers and drawing
+            Detections detections;
+        };
+
+        // The frame, if it is processed on the calling thread
+        FrameJob job_;
+
+        // What a frame publishes, filled in while it is finished
+        struct Output {
+            uint64_t seq;
+            bool measurements;                  // publish `measurement_msg`
+            aruco_localization::MarkerMeasurementArray measurement_msg;
+            bool estimate;                      // publish (and broadcast) the map pose
+            tf::Transform transform;            // of the map w.r.t. the camera
+            ros::Time stamp;
+            cv_bridge::CvImagePtr image;        // the output video frame, if anyone listens
+        };
+
+        // With `async_publish`, the outputs are handed over to a publisher
+        // thread that fills in, serializes and publishes the messages, so the
+        // frame thread does not wait on ROS. A frame's outputs are dropped
+        // (and counted) if the publisher is too far behind.
+        bool asyncPublish_;
+        SpscQueue<Output> outputs_;
+        Output syncOutput_;                     // without the publisher thread
+        Output* output_;                        // of the frame being finished
+        std::thread publisherThread_;
+        std::atomic<bool> stopPublisher_;
+        std::mutex publisherMutex_;             // only for the publisher to sleep on
+        std::condition_variable publisherWake_;
+
+        // Frame workers: the stages that only look at one frame (preprocessing,
+        // quality check and detection), with their own copy of the state of
+        // those stages. Everything else is done in frame order, after them.
+        struct FrontEnd {
+            std::unique_ptr<DetectorBackend> detector;
+            NestedMarkerDetector nested;
+            FrameQuality quality;
+        };
+        std::vector<FrontEnd> frontEnds_;
+        OrderedPool<FrameJob> frameWorkers_;
+
+        // Pipeline statistics, published every `statsPeriod_` frames
+        int statsPeriod_;
+        aruco_localization::LocalizerStats stats_;
+
+        // Hardware performance counters of each stage of the pipeline
+        enum Stage { STAGE_CONVERT, STAGE_QUALITY, STAGE_DETECT, STAGE_MEASURE, STAGE_MAP, STAGE_OUTPUT, NUM_STAGES };
+        bool pmuRequested_;
+        StageCounters pmu_;
+
+        // side length (in pixels) of the published marker patches
+        int patchSize_;
+
+        // Stages of processImage() that a pipeline variant is made of
+        enum PipelineFlags {
+            PIPE_DRAW = 1,      // draw the detections on the frame
+            PIPE_FILTER = 2,    // skip frames of poor quality
+            PIPE_EULER = 4,     // add Euler angles to the measurements
+            PIPE_MEASURE = 8,   // publish the individual markers
+            PIPE_POSES = 16,    // with their poses
+            PIPE_MAP = 32,      // estimate the pose of the marker map
+            PIPE_GENERIC = 64   // the stages are read from `genericFlags_` at run time instead
+        };
+
+        // The processImage() variant selected at startup
+        typedef void (ArucoLocalizer::*Pipeline)(FrameJob& job);
+        Pipeline pipeline_;
+
+        // Stages of the generic variant (processImage<PIPE_GENERIC>)
+        unsigned genericFlags_;
+
+        // Timing mode (`pipeline_timing` frames per variant): the frames go
+        // through every variant in turn, each one alternating with the generic
+        // variant made of the same stages, and the per-frame times are logged
+        struct PipelineTiming {
+            std::string name;
+            unsigned flags;
+            Pipeline pipeline;
+            std::vector<double> specializedMs;
+            std::vector<double> genericMs;
+        };
+        int pipelineTiming_;
+        std::vector<PipelineTiming> pipelineTimings_;
+        size_t pipelineTimingFrame_;
+
         bool showOutputVideo_;
         bool debugSaveInputFrames_;
         bool debugSaveOutputFrames_;
@@ -69,20 +286,93 @@ namespace aruco_localizer {
         // image_transport camera subscriber
         void cameraCallback(const sensor_msgs::ImageConstPtr& image, const sensor_msgs::CameraInfoConstPtr& cinfo);
 
+        // Convert the incoming image to what the detector works on: BGR8,
+        // or mono8 for high-bit-depth mono cameras
+        cv_bridge::CvImagePtr convertImage(const sensor_msgs::ImageConstPtr& image);
+
+        // shared memory frame ring consumer
+        void cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& cinfo);
+        void frameRingLoop();
+
+        // Everything after the conversion of an incoming frame, on this thread
+        // or handed over to the frame workers
+        void processFrame(const cv_bridge::CvImagePtr& cv_ptr, const sensor_msgs::CameraInfoConstPtr& cinfo);
+
+        // Preprocessing, quality check and detection of a frame. `pmu` is null
+        // on frame workers.
+        void runFrontEnd(FrameJob& job, DetectorBackend& detector, NestedMarkerDetector& nested,
+                         FrameQuality& quality, StageCounters* pmu);
+
+        // Everything that depends on earlier frames (tracking), and the outputs
+        void finishFrame(FrameJob& job);
+
+        // Publish the outputs of a frame, on the publisher thread if there is one
+        void publishOutput(Output& output);
+        void publisherLoop();
+
+        // Add the frame's marker poses to the map that is being built
+        void updateMarkerMapping();
+
+        // Trigger the black box on tracking loss or a jump of the map pose
+        void checkBlackBoxTriggers(bool tracked, const cv::Mat& tvec);
+
+        // Open the PMU counters on the frame processing thread, if requested
+        void openPmu();
+
         // service handlers
         bool calibrateAttitude(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+        bool dumpBlackBox(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+        bool updateMarkerMap(aruco_localization::UpdateMarkerMap::Request &req, aruco_localization::UpdateMarkerMap::Response &res);
+        bool saveMarkerMap(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+
+        // This is where the real ArUco processing is done. Every stage that can
+        // be switched off by the configuration is a template flag, so that each
+        // variant of the pipeline only contains the stages it needs.
+        template <unsigned Flags>
+        void processImage(FrameJob& job);
+
+        // Whether `stage` is part of the processImage<Flags> variant (known at
+        // compile time, except for the generic variant)
+        template <unsigned Flags>
+        bool hasStage(unsigned stage) const { return (Flags & PIPE_GENERIC) ? (genericFlags_ & stage) != 0 : (Flags & stage) != 0; }
+
+        // Pick the processImage() variant for a `pipeline_mode` and options
+        Pipeline selectPipeline(const std::string& mode, bool draw, bool filter, bool euler);
+        template <unsigned Mode>
+        Pipeline selectPipeline(bool draw, bool filter, bool euler);
+
+        // The stages of the variant that selectPipeline() picks
+        static unsigned pipelineFlags(const std::string& mode, bool draw, bool filter, bool euler);
 
-        // This is where the real ArUco processing is done
-        void processImage(cv::Mat& frame, bool drawDetections);
+        // Run the frame through the next variant of the timing mode, and log
+        // the times once every variant had `pipelineTiming_` frames
+        void timePipelines(FrameJob& job);
+
+        // Publish the image corners of the detected markers (streaming output)
+        void publishMarkerCorners(const Detections& markers);
+
+        // Rectify each detected marker into a fixed-size patch and publish them as one message
+        void publishMarkerPatches(const cv::Mat& frame, const Detections& markers);
+
+        // Returns false (and counts the skip) if the frame is not worth detecting on
+        bool checkFrameQuality(const FrameJob& job);
+
+        // Publish the pipeline statistics every so often
+        void updateStats();
 
         // Convert ROS CameraInfo message to ArUco style CameraParameters
         aruco::CameraParameters ros2arucoCamParams(const sensor_msgs::CameraInfoConstPtr& cinfo);
 
         // functions to convert to tf and then broadcast
         tf::Quaternion rodriguesToTFQuat(const cv::Mat& rvec);
+        tf::Quaternion rodriguesToTFQuat(const cv::Vec3f& rvec);
         tf::Transform aruco2tf(const cv::Mat& rvec, const cv::Mat& tvec);
+        tf::Transform aruco2tf(const cv::Vec3f& rvec, const cv::Vec3f& tvec);
         void sendtf(const cv::Mat& rvec, const cv::Mat& tvec);
 
+        // Keep track of whether the set of detected markers changed
+        void updateMarkerSet(const Detections& markers);
+
         // Save the current frame to file. Useful for debugging
         void saveInputFrame(const cv::Mat& frame);
         void saveOutputFrame(const cv::Mat& frame);
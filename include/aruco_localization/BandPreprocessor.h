@@ -0,0 +1,40 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include "aruco_localization/Executor.h"
+
+namespace aruco_localizer {
+
+    // Fused, cache-blocked preprocessing of a frame.
+    //
+    // Instead of streaming the whole frame through memory once per step, the
+    // frame is cut into horizontal bands that fit in the cache and each band
+    // is converted to gray and sampled down while it is still hot. Bands are
+    // independent, so they are spread over the executor.
+    class BandPreprocessor
+    {
+    public:
+        BandPreprocessor();
+
+        // every `decimation`-th pixel in each direction ends up in `sampled`
+        void setDecimation(int decimation) { decimation_ = std::max(1, decimation); }
+
+        // bytes of input and output that one band may touch
+        void setBandBytes(int bytes) { bandBytes_ = std::max(1, bytes); }
+
+        int getDecimation() const { return decimation_; }
+
+        // Produce the gray version of a BGR or mono8 `frame` (shared, not
+        // copied, if the frame already is gray; never converted into while
+        // it still shares an earlier frame) and, unless `sampled` is null, a
+        // sampled copy of it
+        void process(const cv::Mat& frame, cv::Mat& gray, cv::Mat* sampled,
+                     Executor& executor, Executor::Clock::time_point deadline);
+
+    private:
+        int decimation_;
+        int bandBytes_;
+    };
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "aruco_localization/Detections.h"
+#include "aruco_localization/DetectorBackend.h"
+#include "aruco_localization/NumaPool.h"
+
+namespace aruco_localizer {
+
+    // Offline marker detection on a sequence of recorded frames (image files).
+    //
+    // Each NUMA node has its own pool of worker threads, bound to its CPUs,
+    // and its own pool of frame buffers, first touched by the worker that
+    // uses it. A worker reads, decodes and detects a frame by itself, so a
+    // frame never leaves the node it was decoded on. Frames are claimed one
+    // at a time from a shared counter, which balances the nodes.
+    class BatchProcessor
+    {
+    public:
+        struct Input {
+            std::string file;
+            double stamp;       // time of the frame (s)
+        };
+
+        struct NodeStats {
+            int node;
+            size_t threads;
+            uint64_t frames;
+            uint64_t failed;    // could not be read or decoded
+            uint64_t inPlace;   // decoded straight into the node's frame pool
+            uint64_t bytes;     // read from disk
+            double busy;        // thread seconds spent on frames
+        };
+
+        // Gets the detections of each input, in input order
+        typedef std::function<void(size_t index, const Input& input, const Detections& detections)> Sink;
+
+        BatchProcessor();
+
+        void setDetector(const std::string& backend, const DetectorBackend::Options& options);
+
+        // Worker threads per node (0: one per CPU of the node)
+        void setThreadsPerNode(int threads) { threadsPerNode_ = threads; }
+
+        // Without NUMA, all CPUs are one node and threads are not bound
+        void setNuma(bool numa) { numa_ = numa; }
+
+        void setHugePages(FramePool::HugePages hugePages) { hugePages_ = hugePages; }
+
+        // Size of each frame buffer, larger frames are decoded on the heap
+        void setMaxFrameBytes(size_t bytes) { maxFrameBytes_ = bytes; }
+
+        // Throws std::runtime_error (e.g., for an unknown backend)
+        void run(const std::vector<Input>& inputs, const Sink& sink);
+
+        const std::vector<NodeStats>& getNodeStats() const { return stats_; }
+        double getSeconds() const { return seconds_; }
+
+        // The images of a directory, sorted by time, then file name. A file
+        // name that is a number (e.g., 1650000000.123456.png) is taken as the
+        // frame's time, otherwise frames are 1 s apart in file name order.
+        // This is the order in which BatchShards merges the shards.
+        static std::vector<Input> listDirectory(const std::string& dir);
+
+    private:
+        struct Node {
+            NumaTopology::Node topology;
+            FramePool pool;
+            NodeStats stats;
+            std::mutex mutex;
+        };
+
+        std::string backend_;
+        DetectorBackend::Options options_;
+        int threadsPerNode_;
+        bool numa_;
+        FramePool::HugePages hugePages_;
+        size_t maxFrameBytes_;
+
+        std::vector<NodeStats> stats_;
+        double seconds_;
+
+        // Frames are claimed in order, and their results passed on in order
+        std::atomic<size_t> claimed_;
+        std::mutex sinkMutex_;
+        std::map<size_t, Detections> pending_;
+        size_t delivered_;
+
+        void runWorker(Node& node, size_t slot, const std::vector<Input>& inputs, const Sink& sink);
+        void deliver(size_t index, const Detections& detections, const std::vector<Input>& inputs, const Sink& sink);
+    };
+
+}
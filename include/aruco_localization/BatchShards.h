@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "aruco_localization/BatchProcessor.h"
+
+namespace aruco_localizer {
+
+    // A batch job split into shards that run as independent processes (on
+    // one machine, or on cluster nodes that share `dir`).
+    //
+    // The shard of an input only depends on its file name, so every process
+    // agrees on the split without talking to the others. Each shard writes
+    // its output lines in time order to its own file, and checkpoints how
+    // far it got: a restarted shard drops whatever it wrote after its last
+    // checkpoint and carries on from there, and a finished shard is not run
+    // again. Once all shards are finished, their outputs are merged into one,
+    // in time order.
+    class BatchShards
+    {
+    public:
+        // Progress of one shard
+        struct Checkpoint {
+            uint64_t frames;        // inputs of the shard that are done
+            uint64_t bytes;         // size of the shard's output after them
+            uint64_t fingerprint;   // of the shard's inputs, to catch a changed input set
+            bool finished;
+        };
+
+        BatchShards(const std::string& dir, size_t shards);
+
+        size_t size() const { return shards_; }
+
+        // The inputs of `shard`, ordered by time (then file name)
+        std::vector<BatchProcessor::Input> select(const std::vector<BatchProcessor::Input>& inputs, size_t shard) const;
+
+        std::string outputPath(size_t shard) const;
+
+        // Returns false if the shard has not checkpointed yet. Throws std::runtime_error.
+        bool load(size_t shard, Checkpoint& checkpoint) const;
+
+        // Replaces the checkpoint atomically (the output must be synced
+        // before). Throws std::runtime_error.
+        void save(size_t shard, const Checkpoint& checkpoint) const;
+
+        // Merge the outputs of all shards, whose lines start with
+        // `stamp,file,` (see fileField()), into `output` (replaced
+        // atomically). Throws std::runtime_error if a shard is not finished.
+        void merge(const std::string& output) const;
+
+        // The file name (without its directory) of `file` as a CSV field,
+        // quoted if it contains a comma or a quote
+        static std::string fileField(const std::string& file);
+
+        static uint64_t fingerprint(const std::vector<BatchProcessor::Input>& inputs);
+
+    private:
+        std::string dir_;
+        size_t shards_;
+
+        std::string checkpointPath(size_t shard) const;
+
+        // FNV-1a: stable across machines, compilers and runs (unlike std::hash)
+        static uint64_t hash(const std::string& text, uint64_t seed = 14695981039346656037ULL);
+    };
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ros/ros.h>
+#include <opencv2/opencv.hpp>
+#include <aruco/aruco.h>
+
+#include "aruco_localization/Detections.h"
+
+namespace aruco_localizer {
+
+    // Keeps the last frames and their detections in memory, so that they can
+    // be written to disk after something went wrong (e.g., tracking was lost).
+    //
+    // Frames are copied into a ring of buffers that is allocated once, for
+    // the size of the first frame. A trigger records a few more frames and
+    // then swaps the ring with a spare one (so recording goes on without
+    // allocating), which a background thread writes to disk. Triggers are
+    // ignored until that dump is done.
+    class BlackBox
+    {
+    public:
+        BlackBox();
+        ~BlackBox();
+
+        // Keep `frames` frames, plus `postFrames` after a trigger, recorded at
+        // up to `rate` frames per second, with up to `maxMarkers` detections
+        // each. Dumps go into directories under `path`.
+        void configure(size_t frames, size_t postFrames, double rate, size_t maxMarkers, const std::string& path);
+        bool isEnabled() const { return frames_ > 0; }
+
+        // Copy a frame into the ring, unless it is closer than 1/rate to the
+        // last recorded one. Its detections follow with `setDetections`.
+        void record(const cv::Mat& frame, const ros::Time& stamp);
+        void setDetections(const Detections& detections);
+
+        // Dump the ring once the post-trigger frames are in. Thread safe.
+        // Returns false if a dump is already under way.
+        bool trigger(const std::string& reason);
+
+    private:
+        struct Detection {
+            int id;
+            cv::Point2f corners[4];
+        };
+
+        struct Ring {
+            std::vector<cv::Mat> images;
+            std::vector<ros::Time> stamps;
+            std::vector<Detection> detections;  // maxMarkers_ per frame
+            std::vector<size_t> counts;
+            size_t next;
+            size_t size;
+        };
+
+        size_t frames_;
+        size_t postFrames_;
+        size_t maxMarkers_;
+        std::string path_;
+
+        // minimum time between recorded frames, and whether the last frame was
+        ros::Duration period_;
+        ros::Time lastRecorded_;
+        bool recorded_;
+
+        // `active_` is recorded to, `spare_` is being written to disk or idle
+        Ring rings_[2];
+        Ring* active_;
+        Ring* spare_;
+        size_t current_;
+
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        bool triggered_;
+        bool dumping_;
+        size_t postRemaining_;
+        std::string reason_;
+        ros::Time lastStamp_;
+        ros::Time triggerStamp_;
+        bool stop_;
+        std::thread writer_;
+
+        bool fits(const Ring& ring, const cv::Mat& frame) const;
+        void allocate(Ring& ring, const cv::Mat& frame);
+        void writerLoop();
+        void dump(const Ring& ring, const ros::Time& stamp, const std::string& reason);
+    };
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <ros/ros.h>
+#include <tf/tf.h>
+
+namespace aruco_localizer {
+
+    // Suppresses publishing (almost) identical poses over and over again.
+    //
+    // A set of poses, each identified by a key (e.g., a marker ID), passes
+    // the dead band if any of them moved more than the translation/rotation
+    // thresholds since they were last published, if a pose was added, or if
+    // the last publish is older than the maximum interval.
+    class DeadBand
+    {
+    public:
+        struct Pose {
+            int key;
+            tf::Vector3 position;
+            tf::Quaternion orientation;
+        };
+
+        DeadBand();
+
+        void setThresholds(double translation, double rotation) { translation_ = translation; rotation_ = rotation; }
+        void setMaxInterval(double seconds) { maxInterval_ = ros::Duration(seconds); }
+
+        // Returns true (and remembers `poses` as published) if they should be
+        // published. `force` publishes regardless of the dead band.
+        bool update(const std::vector<Pose>& poses, const ros::Time& now, bool force = false);
+
+    private:
+        double translation_;
+        double rotation_;
+        ros::Duration maxInterval_;
+
+        // poses as they were last published
+        std::map<int, Pose> last_;
+        ros::Time lastTime_;
+    };
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // The markers of a frame as flat, parallel arrays (structure of arrays).
+    //
+    // Unlike aruco::Marker, which owns a vector of corners and two heap
+    // cv::Mats, every field is a contiguous array of fixed-size elements, and
+    // the arrays keep their capacity from frame to frame. The pipeline works
+    // on these. The detector's aruco::Marker output is only kept for the
+    // parts of the ArUco library that take it (map tracking, drawing).
+    struct Detections {
+        std::vector<int> ids;
+        std::vector<cv::Point2f> corners;   // 4 per marker, clockwise from the top-left
+        std::vector<cv::Vec3f> rvecs;       // pose w.r.t. the camera (Rodrigues), once solved
+        std::vector<cv::Vec3f> tvecs;
+        std::vector<float> errors;          // reprojection error (px) of the pose
+        std::vector<uint8_t> solved;        // has a pose
+        std::vector<uint8_t> flipped;       // the pose flipped w.r.t. the previous frame
+
+        size_t size() const { return ids.size(); }
+
+        const cv::Point2f* cornersOf(size_t i) const { return &corners[4*i]; }
+
+        // Take over the IDs and corners of the markers found by a detector
+        // backend (corners that a marker lacks are zero). The poses are unsolved.
+        void assign(const std::vector<aruco::Marker>& markers);
+    };
+
+}
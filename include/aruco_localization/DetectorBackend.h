@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // A marker detection engine: a frame (gray or BGR) in, the IDs and image
+    // corners (clockwise from the top-left, like ArUco) of its markers out.
+    //
+    // Backends are "aruco" (the ArUco library), "opencv" (OpenCV-contrib's
+    // cv::aruco, if OpenCV was built with it) and "apriltag" (AprilTag 3, if
+    // it was found at build time). They all decode the dictionary of the
+    // marker map, so marker IDs are the same whichever backend is used.
+    class DetectorBackend
+    {
+    public:
+        struct Options {
+            Options() : dictionary("ARUCO_MIP_36h12"), specializedDecoder(true), errorCorrectionRate(0) {}
+
+            std::string dictionary;         // ArUco name of the dictionary
+            bool specializedDecoder;        // aruco: decode with a GridDecoder
+            double errorCorrectionRate;     // fraction of the correctable bit errors that are corrected
+        };
+
+        virtual ~DetectorBackend() {}
+
+        // Replace `markers` by the markers found in `frame`, which only have
+        // their ID and corners set. The markers that are already in the vector
+        // are reused, so that the same number of markers as in the previous
+        // frame takes no new allocations (beyond those of the library).
+        virtual void detect(const cv::Mat& frame, std::vector<aruco::Marker>& markers) = 0;
+
+        std::vector<aruco::Marker> detect(const cv::Mat& frame) {
+            std::vector<aruco::Marker> markers;
+            detect(frame, markers);
+            return markers;
+        }
+
+        virtual std::string getName() const = 0;
+
+        // Throws std::runtime_error if `backend` is not built in, or does not
+        // support the dictionary
+        static std::unique_ptr<DetectorBackend> create(const std::string& backend, const Options& options);
+
+        // Names of the backends that are built in
+        static std::vector<std::string> available();
+    };
+
+}
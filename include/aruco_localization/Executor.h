@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace aruco_localizer {
+
+    // Work-stealing thread pool shared by every localizer in the process.
+    //
+    // Each worker has its own queue, ordered by deadline so that the work of
+    // the stream that is closest to missing its frame runs first. Idle
+    // workers steal from the others. Sharing one pool (instead of one per
+    // localizer) keeps several localizers in one process (e.g., a nodelet
+    // manager) from oversubscribing the cores.
+    class Executor
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Metrics {
+            unsigned int threads;
+            size_t queued;          // tasks waiting to run
+            uint64_t executed;      // tasks run since startup
+            uint64_t steals;        // tasks taken from another worker's queue
+        };
+
+        // The process-wide executor. It is created by the first caller, with
+        // `threads` workers (0: one per hardware thread).
+        static Executor& instance(unsigned int threads = 0);
+
+        explicit Executor(unsigned int threads);
+        ~Executor();
+
+        // Queue a task. Tasks with an earlier deadline are run first.
+        void submit(std::function<void()> task, Clock::time_point deadline);
+
+        // Run fn(0) ... fn(n-1) on the pool and the calling thread, and wait for all of them
+        void parallelFor(size_t n, const std::function<void(size_t)>& fn, Clock::time_point deadline);
+
+        // Like parallelFor, but also run then(i) on the calling thread, in
+        // index order, as soon as fn(0) ... fn(i) have finished (while the
+        // rest are still running)
+        void parallelForOrdered(size_t n, const std::function<void(size_t)>& fn,
+                                const std::function<void(size_t)>& then, Clock::time_point deadline);
+
+        Metrics metrics() const;
+
+    private:
+        struct Task {
+            std::function<void()> fn;
+            Clock::time_point deadline;
+            uint64_t seq;
+
+            // std::priority_queue is a max-heap: earliest deadline (then FIFO) on top
+            bool operator<(const Task& other) const {
+                return deadline != other.deadline ? deadline > other.deadline : seq > other.seq;
+            }
+        };
+
+        struct Worker {
+            std::mutex mutex;
+            std::priority_queue<Task> queue;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::atomic<bool> stop_;
+        std::atomic<size_t> queued_;
+        std::atomic<uint64_t> executed_;
+        std::atomic<uint64_t> steals_;
+        std::atomic<uint64_t> seq_;
+
+        // idle workers sleep here
+        std::mutex sleepMutex_;
+        std::condition_variable wake_;
+
+        void run(unsigned int self);
+
+        // Take a task from worker `self`'s queue, or steal one from another
+        bool pop(unsigned int self, Task& task);
+
+        Executor(const Executor&);
+        Executor& operator=(const Executor&);
+    };
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // Cheap pre-detection check that rejects frames that are too blurred or
+    // too badly exposed for marker detection to produce anything useful.
+    class FrameQuality
+    {
+    public:
+        enum Verdict { GOOD, BLURRED, UNDEREXPOSED, OVEREXPOSED };
+
+        FrameQuality();
+
+        void setDecimation(int decimation) { decimation_ = std::max(1, decimation); }
+        void setMinSharpness(double sharpness) { minSharpness_ = sharpness; }
+        void setBrightnessLimits(double min, double max) { minBrightness_ = min; maxBrightness_ = max; }
+
+        // Estimate the quality of a BGR or mono8 frame
+        Verdict assess(const cv::Mat& frame);
+
+        // Same, for a frame that was already sampled down to mono8 (e.g., by the BandPreprocessor)
+        Verdict assessSampled(const cv::Mat& sampled);
+
+        // metrics of the last assessed frame
+        double sharpness() const { return sharpness_; }
+        double brightness() const { return brightness_; }
+
+    private:
+        // only every `decimation_`-th pixel in each direction is looked at
+        int decimation_;
+
+        // Laplacian variance below which a frame is considered blurred
+        double minSharpness_;
+
+        // acceptable range of the mean intensity
+        double minBrightness_;
+        double maxBrightness_;
+
+        double sharpness_;
+        double brightness_;
+
+        // buffers reused from frame to frame
+        cv::Mat sampled_;
+        cv::Mat gray_;
+        cv::Mat laplacian_;
+    };
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+namespace aruco_localizer {
+
+    // Ring of frames in POSIX shared memory, written by one producer (e.g., a
+    // camera driver) and read zero-copy by any number of consumer processes.
+    //
+    // Frame `seq` always goes into slot `seq % slots`. Consumers hold a
+    // reference on a slot while they use its pixels; the producer skips a
+    // slot that is still referenced (and its sequence number) rather than
+    // overwrite it, so a consumer that holds on to a slot, or died holding
+    // it, only takes that slot out of the ring. Sequence numbers start at 1
+    // and tell consumers which ones they missed.
+    //
+    // A producer that restarts replaces the ring with a new one, and a
+    // consumer has to re-attach to see its frames (see replaced()).
+    class FrameRing
+    {
+    public:
+        // A frame that a consumer holds a reference on
+        struct Frame {
+            uint64_t seq;
+            uint64_t skipped;   // sequence numbers skipped by the producer up to this frame
+            uint64_t stamp;     // ns since the epoch
+            uint32_t width;
+            uint32_t height;
+            uint32_t step;      // bytes per row
+            int32_t type;       // OpenCV type, e.g., CV_8UC3
+            const uint8_t* data;
+            uint32_t slot;
+        };
+
+        FrameRing();
+        ~FrameRing();
+
+        // Producer: create (or replace) the ring `name`. Throws std::runtime_error.
+        void create(const std::string& name, uint32_t slots, uint64_t slotBytes);
+
+        // Consumer: map an existing ring. Throws std::runtime_error.
+        void attach(const std::string& name);
+
+        // Consumer: unmap the ring
+        void detach();
+
+        // Consumer: whether the ring was replaced (or removed) by its producer
+        // since it was attached
+        bool replaced() const;
+
+        bool isOpen() const { return header_ != nullptr; }
+        uint64_t slotBytes() const;
+
+        // Producer: copy a frame into the next slot that is not being read.
+        // Returns false if the frame was dropped because all of them are, or
+        // it does not fit.
+        bool publish(const uint8_t* data, uint32_t width, uint32_t height, uint32_t step,
+                     int32_t type, uint32_t bytesPerPixel, uint64_t stamp);
+
+        // Sequence numbers the producer skipped because their slot was still being read
+        uint64_t skipped() const;
+
+        // Consumer: take a reference on the newest frame if it is newer than `after`
+        bool acquire(uint64_t after, Frame& frame);
+
+        // Consumer: give the reference back, `frame.data` is invalid afterwards
+        void release(const Frame& frame);
+
+    private:
+        struct Header;
+        struct Slot;
+
+        Header* header_;
+        size_t size_;
+        std::string name_;
+        bool owner_;
+        uint64_t generation_;
+
+        Slot* slot(uint32_t index) const;
+        void map(int fd, size_t size);
+
+        FrameRing(const FrameRing&);
+        FrameRing& operator=(const FrameRing&);
+    };
+
+}
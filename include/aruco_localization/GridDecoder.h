@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    namespace detail {
+
+        // Compile-time index sequence (std::index_sequence is C++14)
+        template <int... I> struct Indices {};
+        template <int N, int... I> struct MakeIndices : MakeIndices<N-1, N-1, I...> {};
+        template <int... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+        // Smallest unsigned integer that holds a code of `Bits` bits
+        template <int Bits>
+        struct CodeType {
+            typedef typename std::conditional<Bits <= 16, uint16_t,
+                    typename std::conditional<Bits <= 32, uint32_t, uint64_t>::type>::type type;
+        };
+
+        // Source bit of every bit of an NxN code rotated by 90 degrees, i.e.,
+        // cell (r,c) of the rotated code is cell (N-1-c, r) of the original.
+        // This is the same rotation as ArUco's dictionary based labeler uses.
+        // The table is the same whether bit 0 is the first or the last cell.
+        template <int N, typename Seq = typename MakeIndices<N*N>::type> struct RotationTable;
+        template <int N, int... I>
+        struct RotationTable<N, Indices<I...>> {
+            static constexpr uint8_t value[N*N] = { static_cast<uint8_t>((N - 1 - I % N)*N + I / N)... };
+        };
+        template <int N, int... I>
+        constexpr uint8_t RotationTable<N, Indices<I...>>::value[N*N];
+
+        inline int popcount(uint64_t x) { return __builtin_popcountll(x); }
+
+    }
+
+    // Marker labeler for dictionaries of NxN bit markers.
+    //
+    // The bits are packed into the smallest fixed-width integer that holds
+    // them, so that matching against the dictionary is an XOR and a popcount
+    // per code and rotation, and rotating a code is a (compile-time) table of
+    // bit moves.
+    template <int N>
+    class GridDecoder : public aruco::MarkerLabeler
+    {
+    public:
+        static_assert(N*N <= 64, "codes of more than 64 bits are not supported");
+        typedef typename detail::CodeType<N*N>::type Code;
+
+        // pixels per cell of the canonical marker image
+        static const int CELL = 8;
+
+        // `maxCorrection` is the number of bit errors that are still accepted
+        GridDecoder(const aruco::Dictionary& dictionary, int maxCorrection) :
+            name_(dictionary.getName()), maxCorrection_(maxCorrection)
+        {
+            for (const auto& entry : dictionary.getMapCode()) {
+                codes_.push_back(static_cast<Code>(entry.first));
+                ids_.push_back(entry.second);
+            }
+        }
+
+        bool detect(const cv::Mat& in, int& marker_id, int& nRotations) override {
+            Code code;
+            if (!read(in, code)) return false;
+
+            int bestDistance = maxCorrection_ + 1;
+            for (int rot=0; rot<4; ++rot) {
+                for (size_t i=0; i<codes_.size(); ++i) {
+                    int distance = detail::popcount(code ^ codes_[i]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        marker_id = ids_[i];
+                        nRotations = rot;
+                        if (distance == 0) return true;
+                    }
+                }
+                code = rotate(code);
+            }
+
+            return bestDistance <= maxCorrection_;
+        }
+
+        int getBestInputSize() override { return (N + 2)*CELL; }
+
+        std::string getName() const override { return name_; }
+
+        static Code rotate(Code code) {
+            Code rotated = 0;
+            for (int i=0; i<N*N; ++i)
+                rotated |= static_cast<Code>((code >> detail::RotationTable<N>::value[i]) & 1) << i;
+            return rotated;
+        }
+
+    private:
+        std::string name_;
+        int maxCorrection_;
+
+        // the dictionary, as parallel arrays for a tight matching loop
+        std::vector<Code> codes_;
+        std::vector<int> ids_;
+
+        // Read the bits of a canonical (gray) marker image. Returns false if
+        // it has no contrast or its border is not black.
+        bool read(const cv::Mat& in, Code& code) const {
+            const int cells = N + 2;
+            const int cw = in.cols / cells;
+            const int ch = in.rows / cells;
+            if (cw < 2 || ch < 2 || in.type() != CV_8UC1) return false;
+
+            // Mean of the central half of every cell, away from the blurred edges
+            int means[(N + 2)*(N + 2)];
+            int lo = 255, hi = 0;
+            for (int r=0; r<cells; ++r) {
+                for (int c=0; c<cells; ++c) {
+                    int sum = 0, n = 0;
+                    for (int y=r*ch + ch/4; y<(r+1)*ch - ch/4; ++y) {
+                        const uint8_t* row = in.ptr<uint8_t>(y);
+                        for (int x=c*cw + cw/4; x<(c+1)*cw - cw/4; ++x, ++n)
+                            sum += row[x];
+                    }
+
+                    int mean = sum / std::max(n, 1);
+                    means[r*cells + c] = mean;
+                    lo = std::min(lo, mean);
+                    hi = std::max(hi, mean);
+                }
+            }
+
+            if (hi - lo < 20) return false;
+            const int threshold = (lo + hi) / 2;
+
+            code = 0;
+            for (int r=0; r<cells; ++r) {
+                for (int c=0; c<cells; ++c) {
+                    bool white = means[r*cells + c] > threshold;
+                    bool border = r == 0 || c == 0 || r == cells - 1 || c == cells - 1;
+
+                    if (border) {
+                        if (white) return false;
+                    } else if (white) {
+                        // row-major from the top-left cell, MSB first (the bottom-right
+                        // cell is bit 0), like ArUco's dictionary codes
+                        code |= static_cast<Code>(1) << (N*N - 1 - ((r - 1)*N + (c - 1)));
+                    }
+                }
+            }
+
+            return true;
+        }
+    };
+
+    // Decoder specialized for the grid size of a predefined dictionary, or
+    // an empty pointer if the dictionary is not predefined or the grid size
+    // is not supported
+    cv::Ptr<aruco::MarkerLabeler> createGridDecoder(const std::string& dictionary, double errorCorrectionRate);
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // A marker map that can be edited while it is in use.
+    //
+    // Readers take a snapshot of the current state, which never changes, and
+    // are never blocked. An edit copies the current state, changes the copy
+    // and swaps it in (read-copy-update); readers that still hold the old
+    // snapshot keep using it until they let go. Edits are serialized.
+    class LiveMarkerMap
+    {
+    public:
+        enum Operation { INSERT, UPDATE, REMOVE };
+
+        struct State {
+            aruco::MarkerMap map;
+            std::unordered_map<int, size_t> index;  // marker ID -> entry in `map`
+            uint64_t version;
+        };
+        typedef std::shared_ptr<const State> StatePtr;
+
+        LiveMarkerMap();
+
+        // Start over with `map`, which must be expressed in meters
+        void reset(const aruco::MarkerMap& map);
+
+        StatePtr get() const { return std::atomic_load(&state_); }
+
+        // Insert, update or remove the markers `ids`, with 4 `corners` each (not
+        // used to remove). Either all of them are changed, or (returning false
+        // and why in `error`) none.
+        bool apply(Operation op, const std::vector<int>& ids, const std::vector<cv::Point3f>& corners, std::string& error);
+
+    private:
+        std::shared_ptr<const State> state_;
+        std::mutex writeMutex_;
+    };
+
+}
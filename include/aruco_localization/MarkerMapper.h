@@ -0,0 +1,69 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+#include <tf/tf.h>
+
+namespace aruco_localizer {
+
+    // Builds a marker map from the live stream, without a surveyed map.
+    //
+    // The first marker that is seen is the origin of the map. In every frame,
+    // the camera is located from the markers that are already in the map,
+    // markers seen for the first time are added where the camera sees them,
+    // and the known markers are fused with their new observation, weighted by
+    // the number of earlier observations (up to a maximum, so the fusion does
+    // not freeze). Every frame costs time in the number of markers it sees,
+    // not in the size of the map; the markers it changed are collected, so
+    // that users can follow the map without going through all of it.
+    class MarkerMapper
+    {
+    public:
+        // Pose of a detected marker w.r.t. the camera
+        struct Observation {
+            int id;
+            tf::Transform pose;
+        };
+
+        struct Entry {
+            tf::Transform pose;     // w.r.t. the origin marker
+            double weight;          // number of fused observations
+        };
+
+        MarkerMapper();
+
+        void setMarkerSize(double size) { markerSize_ = size; }
+        void setMaxWeight(double weight) { maxWeight_ = weight; }
+
+        bool isEmpty() const { return markers_.empty(); }
+        const std::map<int, Entry>& getMarkers() const { return markers_; }
+
+        // Add a frame's observations. Returns the number of new markers; the
+        // observations are ignored if none of the markers is known yet.
+        size_t update(const std::vector<Observation>& observations);
+
+        // IDs of the markers that were added or moved since the last call
+        bool hasChanges() const { return !changed_.empty(); }
+        std::vector<int> takeChanges();
+
+        // The map as a (meters) marker map, e.g., to save as `markermap_config`
+        aruco::MarkerMap toMarkerMap(const std::string& dictionary) const;
+
+        // Corners of a marker of `size` at `pose`, in ArUco's order
+        static std::vector<cv::Point3f> corners(const tf::Transform& pose, double size);
+
+    private:
+        double markerSize_;
+        double maxWeight_;
+        int origin_;
+
+        std::map<int, Entry> markers_;
+        std::set<int> changed_;
+    };
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+#include "aruco_localization/DetectorBackend.h"
+
+namespace aruco_localizer {
+
+    // Detection of nested marker layouts: large outer markers with smaller
+    // markers printed inside of them.
+    //
+    // The frame is first searched at a reduced resolution, where the outer
+    // markers are still decodable from far away. Only once an outer marker
+    // is big enough in the image for its inner markers to be resolvable, the
+    // region it covers is searched again at full resolution. If no outer
+    // marker is found at all, e.g., because only markers that are not part
+    // of a layout are in view, the whole frame is searched at full resolution.
+    class NestedMarkerDetector
+    {
+    public:
+        NestedMarkerDetector();
+
+        // Read the `nested_markers` layouts from a (marker map) YAML file:
+        //
+        //   nested_markers:
+        //     - { outer: 10, inner: [ 11, 12, 13, 14 ] }
+        //
+        // Returns the number of layouts found.
+        size_t load(const std::string& file);
+
+        bool isEnabled() const { return !inner_.empty(); }
+
+        // factor by which the frame is shrunk for the first pass
+        void setDecimation(int decimation) { decimation_ = std::max(1, decimation); }
+
+        // full resolution perimeter (px) of an outer marker for its inner markers to be searched
+        void setMinInnerPerimeter(float perimeter) { minInnerPerimeter_ = perimeter; }
+
+        // Replace `markers` by the markers found in `frame`, reusing them like
+        // DetectorBackend::detect
+        void detect(const cv::Mat& frame, DetectorBackend& detector, std::vector<aruco::Marker>& markers);
+
+    private:
+        // inner marker IDs of each outer marker ID
+        std::map<int, std::vector<int>> inner_;
+
+        int decimation_;
+        float minInnerPerimeter_;
+
+        // reused from frame to frame
+        cv::Mat small_;
+        std::vector<aruco::Marker> fine_;
+    };
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace aruco_localizer {
+
+    // The NUMA nodes of the machine and their CPUs, as listed in sysfs.
+    // Machines without NUMA (or without sysfs) are a single node with all CPUs.
+    class NumaTopology
+    {
+    public:
+        struct Node {
+            int id;
+            std::vector<int> cpus;
+        };
+
+        static std::vector<Node> discover();
+
+        // Parse a kernel CPU list, e.g., "0-7,16-23"
+        static std::vector<int> parseCpuList(const std::string& list);
+
+        // Restrict the calling thread to the CPUs of `node`. Memory that the
+        // thread touches first is then allocated on that node (the default,
+        // local, policy). Returns false if the affinity could not be set.
+        static bool bindThread(const Node& node);
+    };
+
+    // Fixed-size frame buffers in one anonymous mapping, optionally backed
+    // by huge pages.
+    //
+    // The mapping is not touched when it is created, so each page is
+    // allocated on the node of the thread that touches it first. Slots are
+    // meant to be touched (with `touch`) by the thread that uses them.
+    class FramePool
+    {
+    public:
+        enum HugePages {
+            HUGEPAGES_NONE,
+            HUGEPAGES_TRANSPARENT,  // madvise(MADV_HUGEPAGE), if THP is enabled
+            HUGEPAGES_EXPLICIT      // MAP_HUGETLB, from the reserved pool (vm.nr_hugepages)
+        };
+
+        FramePool();
+        ~FramePool();
+
+        // Throws std::runtime_error. Explicit huge pages fall back to
+        // transparent ones if none are reserved (see `hugePages`).
+        void create(size_t slots, size_t slotBytes, HugePages hugePages);
+
+        size_t slots() const { return slots_; }
+        size_t slotBytes() const { return slotBytes_; }
+        HugePages hugePages() const { return hugePages_; }
+
+        uint8_t* slot(size_t index) const { return base_ + index*slotBytes_; }
+
+        // Fault in the pages of a slot from the calling thread
+        void touch(size_t index);
+
+        static HugePages parseHugePages(const std::string& mode);
+
+    private:
+        void* map_;
+        size_t mapSize_;
+        uint8_t* base_;     // first slot, aligned within the mapping
+        size_t slots_;
+        size_t slotBytes_;
+        HugePages hugePages_;
+
+        FramePool(const FramePool&);
+        FramePool& operator=(const FramePool&);
+    };
+
+}
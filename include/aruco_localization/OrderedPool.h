@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace aruco_localizer {
+
+    // Runs the jobs of a single producer on several worker threads, and then
+    // finishes them one at a time, in the order in which they were submitted.
+    //
+    // Jobs live in a ring of `capacity` preallocated slots (the reorder
+    // buffer): job `seq` uses slot `seq % capacity`. Workers claim jobs in
+    // order, so a slot is only reused once its job has been finished. The
+    // producer blocks while all of the slots are in use.
+    template <typename Job>
+    class OrderedPool
+    {
+    public:
+        // `work` runs on worker `worker` (0 ... workers-1), `finish` on the finishing thread
+        typedef std::function<void(size_t worker, Job& job)> Work;
+        typedef std::function<void(Job& job)> Finish;
+
+        OrderedPool() : head_(0), claimed_(0), tail_(0), stop_(false) {}
+        ~OrderedPool() { stop(); }
+
+        void start(size_t workers, size_t capacity, Work work, Finish finish) {
+            stop();
+            stop_ = false;
+            head_ = claimed_ = tail_ = 0;
+
+            work_ = work;
+            finish_ = finish;
+            jobs_.resize(capacity);
+            done_.assign(capacity, false);
+
+            for (size_t i=0; i<workers; ++i)
+                threads_.push_back(std::thread(&OrderedPool::runWorker, this, i));
+            finisher_ = std::thread(&OrderedPool::runFinisher, this);
+        }
+
+        // Jobs that were not finished yet are dropped
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cond_.notify_all();
+
+            for (std::thread& thread : threads_)
+                thread.join();
+            threads_.clear();
+
+            if (finisher_.joinable())
+                finisher_.join();
+        }
+
+        bool isRunning() const { return !threads_.empty(); }
+
+        // Producer: the next free slot, to be filled in and then passed on with
+        // `submit`. Returns nullptr if the pool was stopped while waiting.
+        Job* acquire() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stop_ || tail_ - head_ < jobs_.size(); });
+            return stop_ ? nullptr : &jobs_[tail_ % jobs_.size()];
+        }
+
+        void submit() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                done_[tail_ % jobs_.size()] = false;
+                ++tail_;
+            }
+            cond_.notify_all();
+        }
+
+    private:
+        std::vector<Job> jobs_;
+        std::vector<char> done_;
+
+        uint64_t head_;     // next job to finish
+        uint64_t claimed_;  // next job for a worker
+        uint64_t tail_;     // next job to submit
+
+        Work work_;
+        Finish finish_;
+
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        bool stop_;
+
+        std::vector<std::thread> threads_;
+        std::thread finisher_;
+
+        void runWorker(size_t worker) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true) {
+                cond_.wait(lock, [this] { return stop_ || claimed_ < tail_; });
+                if (stop_) return;
+
+                size_t slot = claimed_++ % jobs_.size();
+                lock.unlock();
+                work_(worker, jobs_[slot]);
+                lock.lock();
+
+                done_[slot] = true;
+                cond_.notify_all();
+            }
+        }
+
+        void runFinisher() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true) {
+                cond_.wait(lock, [this] { return stop_ || (head_ < tail_ && done_[head_ % jobs_.size()]); });
+                if (stop_) return;
+
+                size_t slot = head_ % jobs_.size();
+                lock.unlock();
+                finish_(jobs_[slot]);
+                lock.lock();
+
+                ++head_;
+                cond_.notify_all();
+            }
+        }
+    };
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace aruco_localizer {
+
+    // Hardware performance counters (Linux perf_event_open) of the calling
+    // thread. If the PMU cannot be accessed (e.g., perf_event_paranoid, a
+    // container or a VM without a virtual PMU) the counters stay closed and
+    // everything reads as zero.
+    class PerfCounters
+    {
+    public:
+        enum Event { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NUM_EVENTS };
+
+        PerfCounters();
+        ~PerfCounters();
+
+        // Start counting on the calling thread. Returns false if not permitted.
+        bool open();
+        void close();
+        bool isOpen() const { return leader_ >= 0; }
+
+        // Current value of every counter (zero for events that are unavailable)
+        void read(uint64_t values[NUM_EVENTS]) const;
+
+        // Why the counters could not be opened
+        const std::string& error() const { return error_; }
+
+    private:
+        // The counters are read together as one group through the leader
+        int leader_;
+        int fds_[NUM_EVENTS];
+
+        // position of each event in a group read, or -1 if not available
+        int slot_[NUM_EVENTS];
+        int numSlots_;
+
+        std::string error_;
+
+        PerfCounters(const PerfCounters&);
+        PerfCounters& operator=(const PerfCounters&);
+    };
+
+    // Per-stage totals of the performance counters of a pipeline
+    class StageCounters
+    {
+    public:
+        explicit StageCounters(const std::vector<std::string>& stages);
+
+        // Open the counters on the calling thread, see PerfCounters::open()
+        bool open() { return counters_.open(); }
+        bool isOpen() const { return counters_.isOpen(); }
+        const std::string& error() const { return counters_.error(); }
+
+        // Bracket the work of a stage. No-ops if the counters are not open.
+        void begin(int stage);
+        void end(int stage);
+
+        const std::vector<std::string>& stages() const { return stages_; }
+
+        // counts of `stage` since the last reset
+        const uint64_t* totals(int stage) const { return &totals_[stage*PerfCounters::NUM_EVENTS]; }
+
+        void reset();
+
+    private:
+        PerfCounters counters_;
+        std::vector<std::string> stages_;
+
+        // counter values at `begin` and the accumulated deltas, per stage
+        std::vector<uint64_t> start_;
+        std::vector<uint64_t> totals_;
+    };
+
+}
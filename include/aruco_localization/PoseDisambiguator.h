@@ -0,0 +1,70 @@
+#pragma once
+
+#include <map>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // Resolves the planar pose ambiguity of single markers.
+    //
+    // IPPE gives the two poses that explain the four corners of a square
+    // marker. When the marker is small (i.e., far away) both reproject
+    // almost equally well and picking the best one makes the orientation
+    // flip from frame to frame. If the reprojection errors are too close to
+    // call, the candidate that agrees with the previous frame's pose of the
+    // same marker ID is used instead.
+    class PoseDisambiguator
+    {
+    public:
+        // One IPPE solution (Rodrigues rotation and translation, like aruco::Marker)
+        struct Candidate {
+            cv::Vec3f rvec;
+            cv::Vec3f tvec;
+            double error;
+        };
+
+        // Both IPPE solutions of a marker, lowest reprojection error first
+        struct Candidates {
+            Candidate c[2];
+        };
+
+        PoseDisambiguator();
+
+        // error ratio above which the best solution is trusted without history
+        void setMinErrorRatio(double ratio) { minErrorRatio_ = ratio; }
+
+        // rotation (rad) w.r.t. the previous pose above which a solution is a flip
+        void setFlipAngle(double angle) { flipAngle_ = angle; }
+
+        // frames after which the previous pose of a marker is forgotten
+        void setMaxGap(unsigned int frames) { maxGap_ = frames; }
+
+        // Compute both candidate poses of a marker from its 4 corners. Does not touch any state.
+        static bool solve(const cv::Point2f* corners, float markerSize,
+                          const aruco::CameraParameters& camParams, Candidates& candidates);
+
+        // Pick one of the candidates for marker `id` (its pose and reprojection
+        // error) and remember it. Returns true if the selected pose is a flip
+        // w.r.t. the previous frame.
+        bool select(int id, const Candidates& candidates, cv::Vec3f& rvec, cv::Vec3f& tvec, float& error);
+
+        // To be called once per frame, before any `select`
+        void nextFrame() { frame_++; }
+
+    private:
+        double minErrorRatio_;
+        double flipAngle_;
+        unsigned int maxGap_;
+
+        // Previously selected rotation of each marker ID
+        struct Track {
+            cv::Matx33d R;
+            unsigned int frame;
+        };
+        std::map<int, Track> tracks_;
+        unsigned int frame_;
+    };
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+namespace aruco_localizer {
+
+    // Bounded lock-free queue between exactly one producer and one consumer thread.
+    //
+    // Elements live in a ring of preallocated slots and are filled in place:
+    // the producer takes the next free slot with `back`, fills it in and
+    // hands it over with `push`; the consumer reads `front` and gives the
+    // slot back with `pop`. Slots are never destroyed while the queue is in
+    // use, so whatever they own (e.g., the capacity of a vector) is reused.
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        SpscQueue() : head_(0), tail_(0) {}
+
+        // Not thread safe, to be called before either side starts
+        void reset(size_t capacity) {
+            slots_.clear();
+            slots_.resize(capacity);
+            head_ = tail_ = 0;
+        }
+
+        size_t capacity() const { return slots_.size(); }
+
+        // Producer: the next free slot, or nullptr if the queue is full
+        T* back() {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == slots_.size()) return nullptr;
+            return &slots_[tail % slots_.size()];
+        }
+
+        // Producer: hand the slot from `back` over to the consumer
+        void push() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        // Consumer: the oldest element, or nullptr if the queue is empty
+        T* front() {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+            return &slots_[head % slots_.size()];
+        }
+
+        // Consumer: give the slot from `front` back to the producer
+        void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    private:
+        std::vector<T> slots_;
+
+        // Each index is only written by one side; they are kept on separate
+        // cache lines so that the two sides do not invalidate each other's
+        std::atomic<size_t> head_;
+        char pad_[64];
+        std::atomic<size_t> tail_;
+    };
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // A marker map partitioned into zones (e.g., the rooms of a building).
+    //
+    // Every zone is a regular ArUco marker map, all expressed in the same
+    // site frame. Only the active zone and its neighbors are kept in memory,
+    // each with its own pose tracker, so the per-frame cost does not depend
+    // on the size of the whole site. The active zone follows the camera
+    // position and zones are paged in on a background thread.
+    class SubMapManager
+    {
+    public:
+        SubMapManager();
+
+        // Read the zone list from `configFile` and index the marker IDs of
+        // every zone. The maps themselves are only paged in when needed.
+        void load(const std::string& configFile, float markerSize);
+
+        bool isEnabled() const { return !zones_.empty(); }
+
+        // Dictionary used by the zone maps
+        std::string getDictionary() const { return dictionary_; }
+
+        // distance (m) outside of a zone's markers that still belongs to it
+        void setMargin(double margin) { margin_ = margin; }
+
+        // Trackers can only be set up once the camera is known
+        void setCameraParams(const aruco::CameraParameters& camParams);
+
+        // Estimate the camera pose from the active zone (or its neighbors),
+        // switching to another zone if the camera moved into it
+        bool estimatePose(const std::vector<aruco::Marker>& markers);
+
+        cv::Mat getRvec() const { return rvec_; }
+        cv::Mat getTvec() const { return tvec_; }
+
+        // Name of the zone that the camera is currently in
+        std::string getActiveZone() const;
+
+        // Marker size of the zone that produced the last pose, which right
+        // after a zone switch is not the active zone
+        float getMarkerSize() const { return poseMarkerSize_; }
+
+    private:
+        struct Zone {
+            std::string name;
+            std::string file;
+            std::vector<int> neighbors;
+
+            // axis-aligned bounds of the zone's markers in the site frame
+            cv::Point3f min;
+            cv::Point3f max;
+
+            // only set while the zone is paged in
+            std::shared_ptr<aruco::MarkerMap> map;
+            std::unique_ptr<aruco::MarkerMapPoseTracker> tracker;
+
+            // background load that is in progress
+            std::future<std::shared_ptr<aruco::MarkerMap>> pending;
+        };
+
+        std::vector<Zone> zones_;
+
+        // zones that each marker ID belongs to
+        std::map<int, std::vector<int>> zonesOfMarker_;
+
+        std::string dictionary_;
+        float markerSize_;
+        double margin_;
+        aruco::CameraParameters camParams_;
+
+        int active_;
+        float poseMarkerSize_;
+        cv::Mat rvec_;
+        cv::Mat tvec_;
+
+        static std::shared_ptr<aruco::MarkerMap> readMap(const std::string& file, float markerSize);
+
+        // Start loading the active zone and its neighbors, drop all others
+        void page();
+
+        // Set up the trackers of the zones whose loads have finished
+        void collect();
+
+        bool isWanted(int zone) const;
+        bool tryZone(int zone, const std::vector<aruco::Marker>& markers);
+        bool contains(int zone, const cv::Point3f& p) const;
+
+        // Zone that most of the detected markers belong to, or -1
+        int relocalize(const std::vector<aruco::Marker>& markers) const;
+    };
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+#include "aruco_localization/Executor.h"
+
+namespace aruco_localizer {
+
+    // An 8 bit gray image on disk, memory mapped instead of read into memory.
+    // Either a binary PGM (P5) or a headerless raw file of known size.
+    class MappedImage
+    {
+    public:
+        MappedImage();
+        ~MappedImage();
+
+        // `width`/`height` are only needed for raw files. Throws std::runtime_error.
+        void open(const std::string& file, int width = 0, int height = 0);
+        void close();
+
+        int width() const { return width_; }
+        int height() const { return height_; }
+
+        // Copy a region of the image into `out`
+        void read(const cv::Rect& roi, cv::Mat& out) const;
+
+        // Tell the kernel that rows [0, row) will not be read again
+        void release(int row);
+
+    private:
+        int fd_;
+        uint8_t* map_;
+        size_t mapSize_;
+
+        // start of the pixels (after the PGM header)
+        const uint8_t* pixels_;
+        int width_;
+        int height_;
+
+        // rows that were already released
+        int released_;
+
+        MappedImage(const MappedImage&);
+        MappedImage& operator=(const MappedImage&);
+    };
+
+    // Marker detection on images that are too large to comfortably hold in
+    // memory (e.g., orthomosaics with markers as ground control points).
+    //
+    // The image is streamed from disk in strips of overlapping tiles. The
+    // tiles of a strip are detected in parallel, each with its own detector,
+    // and the mapped rows of a strip are dropped once it is done, so the
+    // memory used depends on the tile size and the width of the image only.
+    class TiledDetector
+    {
+    public:
+        struct Detection {
+            int id;
+            cv::Point2f corners[4];
+        };
+
+        TiledDetector();
+
+        void setDictionary(const std::string& dictionary) { dictionary_ = dictionary; }
+        void setTileSize(int size) { tileSize_ = size; }
+
+        // Must be at least twice the size (in pixels) of the largest marker
+        void setOverlap(int overlap) { overlap_ = overlap; }
+
+        // Markers found in the whole image, in image pixel coordinates
+        std::vector<Detection> detect(MappedImage& image, Executor& executor);
+
+    private:
+        std::string dictionary_;
+        int tileSize_;
+        int overlap_;
+
+        // Detectors (and tile buffers) are not thread-safe, so each tile takes one from here
+        struct Slot {
+            aruco::MarkerDetector detector;
+            cv::Mat tile;
+        };
+        std::vector<std::unique_ptr<Slot>> free_;
+        std::mutex mutex_;
+
+        Slot* acquire();
+        void release(Slot* slot);
+    };
+
+}
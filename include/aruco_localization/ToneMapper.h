@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include <opencv2/opencv.hpp>
+
+namespace aruco_localizer {
+
+    // Maps high-bit-depth (mono12/mono16) images straight to 8 bit gray.
+    //
+    // The intensity range is found from the percentiles of a sparsely sampled
+    // histogram and then stretched through a gamma curve, which keeps contrast
+    // in the dark parts of the image instead of just dropping the low bits.
+    // The mapping is a 64K entry lookup table that is only rebuilt when the
+    // range of the scene changes noticeably.
+    class ToneMapper
+    {
+    public:
+        ToneMapper();
+
+        // fraction of the darkest/brightest pixels that are clipped
+        void setClipFraction(double fraction) { clipFraction_ = fraction; }
+
+        // gamma > 1 brightens the dark areas
+        void setGamma(double gamma) { gamma_ = gamma; lo_ = hi_ = -1; }
+
+        // `in` must be CV_16UC1, `out` will be CV_8UC1
+        void apply(const cv::Mat& in, cv::Mat& out);
+
+    private:
+        double clipFraction_;
+        double gamma_;
+
+        // current input range mapped onto [0, 255]
+        int lo_;
+        int hi_;
+
+        // 16 bit to 8 bit lookup table
+        std::vector<uint8_t> lut_;
+
+        // coarse histogram of the input, reused from frame to frame
+        std::vector<uint32_t> hist_;
+
+        void findRange(const cv::Mat& in, int& lo, int& hi);
+        void buildLut(int lo, int hi);
+    };
+
+}
@@ -0,0 +1,286 @@
+#include <cstdio>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "aruco_localization/BatchProcessor.h"
+#include "aruco_localization/BatchShards.h"
+
+// Offline detection of markers in recorded frames (a directory of images),
+// on all NUMA nodes of the machine.
+//
+// Usage: aruco_batch_detect <image directory> [--dictionary ARUCO_MIP_36h12]
+//            [--backend aruco] [--threads-per-node 0] [--numa 1]
+//            [--hugepages none|transparent|explicit] [--max-frame-bytes 12582912]
+//            [--output detections.csv]
+//            [--shards N [--shard K] [--work-dir .] [--checkpoint-every 100]]
+//
+// Writes one line per marker, ordered by time (then file name), with or
+// without shards: stamp,file,id,x0,y0,x1,y1,x2,y2,x3,y3 (the file name
+// without its directory, quoted if it contains a comma; image pixels)
+//
+// With --shards, the frames are split into N shards that run as separate
+// processes, each writing (and checkpointing) its own output in --work-dir.
+// Without --shard, all shards run on this machine and are then merged into
+// --output (default <work-dir>/detections.csv), in time order. With --shard,
+// only shard K runs (e.g., as one task of a cluster job); running again
+// without --shard once all shards are finished merges them.
+
+namespace fs = std::experimental::filesystem;
+
+using aruco_localizer::BatchProcessor;
+using aruco_localizer::BatchShards;
+
+static void writeDetections(FILE* out, const BatchProcessor::Input& input, const aruco_localizer::Detections& detections) {
+    for (size_t i=0; i<detections.size(); ++i) {
+        std::fprintf(out, "%.6f,%s,%d", input.stamp, BatchShards::fileField(input.file).c_str(), detections.ids[i]);
+        for (int k=0; k<4; ++k)
+            std::fprintf(out, ",%.2f,%.2f", detections.cornersOf(i)[k].x, detections.cornersOf(i)[k].y);
+        std::fprintf(out, "\n");
+    }
+}
+
+// Throughput of each node, to see whether the nodes scale
+static void printStats(const BatchProcessor& processor, size_t frames, size_t markers) {
+    for (const auto& node : processor.getNodeStats()) {
+        std::fprintf(stderr, "node %d: %zu threads, %llu frames (%llu failed, %llu decoded in place), "
+                             "%.1f frames/s, %.1f MB/s read, %.0f%% busy\n",
+                     node.node, node.threads, (unsigned long long) node.frames, (unsigned long long) node.failed,
+                     (unsigned long long) node.inPlace, node.frames / processor.getSeconds(),
+                     node.bytes / processor.getSeconds() / 1e6,
+                     100.0 * node.busy / (node.threads * processor.getSeconds()));
+    }
+
+    std::cerr << markers << " markers in " << frames << " frames, "
+              << frames / processor.getSeconds() << " frames/s" << std::endl;
+}
+
+// Run (or resume) one shard. Whatever it wrote after its last checkpoint is dropped.
+static int runShard(BatchProcessor& processor, const BatchShards& shards, size_t shard,
+                    const std::vector<BatchProcessor::Input>& inputs, size_t checkpointEvery) {
+
+    std::vector<BatchProcessor::Input> selected = shards.select(inputs, shard);
+
+    BatchShards::Checkpoint checkpoint = { 0, 0, BatchShards::fingerprint(selected), false };
+    BatchShards::Checkpoint saved;
+    if (shards.load(shard, saved)) {
+        if (saved.fingerprint != checkpoint.fingerprint) {
+            std::cerr << "The frames of shard " << shard << " changed since it was checkpointed, "
+                      << "start over in an empty work directory" << std::endl;
+            return 1;
+        }
+        if (saved.finished) {
+            std::cerr << "Shard " << shard << " is already finished" << std::endl;
+            return 0;
+        }
+        checkpoint = saved;
+    }
+
+    std::string output = shards.outputPath(shard);
+    int fd = ::open(output.c_str(), O_CREAT | O_RDWR, 0644);
+    FILE* out = fd < 0 ? nullptr : fdopen(fd, "r+");
+    if (!out || ftruncate(fd, checkpoint.bytes) != 0 || std::fseek(out, checkpoint.bytes, SEEK_SET) != 0) {
+        std::cerr << "Could not open " << output << std::endl;
+        if (out) std::fclose(out);
+        return 1;
+    }
+
+    // The output is on disk before the checkpoint that covers it
+    auto save = [&](uint64_t frames, bool finished) {
+        std::fflush(out);
+        fsync(fd);
+        checkpoint.frames = frames;
+        checkpoint.bytes = std::ftell(out);
+        checkpoint.finished = finished;
+        shards.save(shard, checkpoint);
+    };
+
+    std::vector<BatchProcessor::Input> remaining(selected.begin() + std::min<size_t>(checkpoint.frames, selected.size()),
+                                                 selected.end());
+    const uint64_t done = checkpoint.frames;
+    size_t markers = 0;
+    std::string error;
+
+    try {
+        processor.run(remaining, [&](size_t index, const BatchProcessor::Input& input,
+                                     const aruco_localizer::Detections& detections) {
+            writeDetections(out, input, detections);
+            markers += detections.size();
+
+            // A failed checkpoint only costs the frames since the previous one on the next run
+            if (error.empty() && (index + 1) % checkpointEvery == 0) {
+                try {
+                    save(done + index + 1, false);
+                } catch (std::exception& e) {
+                    error = e.what();
+                }
+            }
+        });
+
+        if (error.empty()) save(selected.size(), true);
+    } catch (std::exception& e) {
+        error = e.what();
+    }
+
+    std::fclose(out);
+
+    if (!error.empty()) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Shard " << shard << " of " << shards.size() << ": ";
+    printStats(processor, remaining.size(), markers);
+    return 0;
+}
+
+// Run every shard in a process of its own, and wait for all of them
+static bool launchShards(int argc, char** argv, size_t shards, bool threadsGiven) {
+
+    // The shards share the machine
+    std::string threads = std::to_string(std::max<size_t>(1,
+            aruco_localizer::NumaTopology::discover()[0].cpus.size() / shards));
+
+    std::vector<pid_t> children;
+    for (size_t shard=0; shard<shards; ++shard) {
+        std::string index = std::to_string(shard);
+
+        std::vector<char*> args(argv, argv + argc);
+        args.push_back(const_cast<char*>("--shard"));
+        args.push_back(const_cast<char*>(index.c_str()));
+        if (!threadsGiven) {
+            args.push_back(const_cast<char*>("--threads-per-node"));
+            args.push_back(const_cast<char*>(threads.c_str()));
+        }
+        args.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            execv("/proc/self/exe", args.data());
+            std::_Exit(127);
+        }
+        if (pid > 0) children.push_back(pid);
+        else std::cerr << "Could not start shard " << shard << std::endl;
+    }
+
+    bool ok = children.size() == shards;
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <image directory> [--dictionary D] [--backend aruco]"
+                  << " [--threads-per-node 0] [--numa 1] [--hugepages none|transparent|explicit]"
+                  << " [--max-frame-bytes 12582912] [--output file.csv]"
+                  << " [--shards N [--shard K] [--work-dir .] [--checkpoint-every 100]]" << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::string> args;
+    for (int i=2; i+1<argc; i+=2)
+        args[argv[i]] = argv[i+1];
+
+    auto arg = [&args](const std::string& key, const std::string& def) {
+        return args.count(key) ? args[key] : def;
+    };
+
+    aruco_localizer::DetectorBackend::Options options;
+    options.dictionary = arg("--dictionary", "ARUCO_MIP_36h12");
+
+    BatchProcessor processor;
+    std::vector<BatchProcessor::Input> inputs;
+    try {
+        processor.setDetector(arg("--backend", "aruco"), options);
+        processor.setThreadsPerNode(std::atoi(arg("--threads-per-node", "0").c_str()));
+        processor.setNuma(arg("--numa", "1") != "0");
+        processor.setHugePages(aruco_localizer::FramePool::parseHugePages(arg("--hugepages", "none")));
+        processor.setMaxFrameBytes(std::strtoull(arg("--max-frame-bytes", "12582912").c_str(), nullptr, 10));
+        inputs = BatchProcessor::listDirectory(argv[1]);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "No images in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    //
+    // Sharded: run one shard, or all of them and merge
+    //
+
+    size_t shardCount = std::strtoul(arg("--shards", "0").c_str(), nullptr, 10);
+    if (shardCount > 0) {
+        std::string workDir = arg("--work-dir", ".");
+        BatchShards shards(workDir, shardCount);
+        try {
+            fs::create_directories(workDir);
+
+            if (args.count("--shard")) {
+                size_t shard = std::strtoul(args["--shard"].c_str(), nullptr, 10);
+                if (shard >= shardCount) {
+                    std::cerr << "--shard must be less than --shards" << std::endl;
+                    return 1;
+                }
+                size_t every = std::max(1, std::atoi(arg("--checkpoint-every", "100").c_str()));
+                return runShard(processor, shards, shard, inputs, every);
+            }
+
+            if (!launchShards(argc, argv, shardCount, args.count("--threads-per-node") > 0)) {
+                std::cerr << "Not all shards finished, run again to resume them" << std::endl;
+                return 1;
+            }
+
+            std::string output = arg("--output", (fs::path(workDir) / "detections.csv").string());
+            shards.merge(output);
+            std::cerr << "Merged " << shardCount << " shards into " << output << std::endl;
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    //
+    // All frames in this process
+    //
+
+    std::string output = arg("--output", "");
+    FILE* out = output.empty() ? stdout : std::fopen(output.c_str(), "w");
+    if (!out) {
+        std::cerr << "Could not open " << output << std::endl;
+        return 1;
+    }
+
+    size_t markers = 0;
+    try {
+        processor.run(inputs, [out, &markers](size_t, const BatchProcessor::Input& input,
+                                              const aruco_localizer::Detections& detections) {
+            writeDetections(out, input, detections);
+            markers += detections.size();
+        });
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        if (out != stdout) std::fclose(out);
+        return 1;
+    }
+
+    if (out != stdout) std::fclose(out);
+
+    printStats(processor, inputs.size(), markers);
+    return 0;
+}
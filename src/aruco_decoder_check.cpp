@@ -0,0 +1,92 @@
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <aruco/aruco.h>
+#include <opencv2/opencv.hpp>
+
+#include "aruco_localization/GridDecoder.h"
+
+// Checks the grid-size specialized decoders against ArUco's own dictionary
+// based labeler. Every marker of a dictionary is rendered, rotated by k*90
+// degrees and decoded by both, which must find its ID and nRotations == k.
+// The rotation tells the detector which of the corners is the first one, so
+// getting it wrong turns the corners (and every pose made from them).
+//
+// Usage: aruco_decoder_check [--dictionaries ARUCO_MIP_36h12,ARUCO_MIP_25h7,ARUCO_MIP_16h3,ARUCO]
+//
+// Exits with 1 if any marker is not decoded as expected.
+
+// Rotate a square image by 90 degrees counterclockwise, which takes ArUco's
+// labeler one (clockwise) rotation of the bits to undo
+static cv::Mat rotateCounterClockwise(const cv::Mat& in) {
+    cv::Mat transposed, out;
+    cv::transpose(in, transposed);
+    cv::flip(transposed, out, 0);
+    return out;
+}
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::string> args;
+    for (int i=1; i+1<argc; i+=2)
+        args[argv[i]] = argv[i+1];
+
+    std::vector<std::string> dictionaries;
+    std::stringstream list(args.count("--dictionaries") ? args["--dictionaries"] : "ARUCO_MIP_36h12,ARUCO_MIP_25h7,ARUCO_MIP_16h3,ARUCO");
+    for (std::string name; std::getline(list, name, ',');)
+        dictionaries.push_back(name);
+
+    size_t failures = 0;
+    for (const std::string& name : dictionaries) {
+        cv::Ptr<aruco::MarkerLabeler> grid;
+        cv::Ptr<aruco::MarkerLabeler> stock;
+        aruco::Dictionary dictionary;
+        try {
+            grid = aruco_localizer::createGridDecoder(name, 0);
+            stock = aruco::MarkerLabeler::create(aruco::Dictionary::getTypeFromString(name), 0);
+            dictionary = aruco::Dictionary::loadPredefined(name);
+        } catch (std::exception& e) {
+            std::cerr << name << ": " << e.what() << std::endl;
+            failures++;
+            continue;
+        }
+
+        if (grid.empty()) {
+            std::cerr << name << ": no specialized decoder for this grid size" << std::endl;
+            continue;
+        }
+
+        // Rendered at the decoder's own cell size (the border is one cell)
+        const int side = static_cast<int>(std::round(std::sqrt(dictionary.nbits())));
+
+        size_t checked = 0, failed = 0;
+        for (const auto& entry : dictionary.getMapCode()) {
+            const int id = entry.second;
+            cv::Mat image = dictionary.getMarkerImage_id(id, grid->getBestInputSize() / (side + 2), false);
+            if (image.channels() != 1) cv::cvtColor(image, image, cv::COLOR_BGR2GRAY);
+
+            for (int k=0; k<4; ++k, image = rotateCounterClockwise(image)) {
+                int gridId = -1, gridRotations = -1, stockId = -1, stockRotations = -1;
+                bool gridFound = grid->detect(image, gridId, gridRotations);
+                bool stockFound = stock->detect(image, stockId, stockRotations);
+                checked++;
+
+                if (!gridFound || !stockFound || gridId != id || stockId != id || gridRotations != k || stockRotations != k) {
+                    if (failed++ < 10)
+                        std::cerr << name << ": marker " << id << " rotated " << k << "x90: "
+                                  << "grid decoder " << (gridFound ? std::to_string(gridId) + " rot " + std::to_string(gridRotations) : "none")
+                                  << ", ArUco " << (stockFound ? std::to_string(stockId) + " rot " + std::to_string(stockRotations) : "none")
+                                  << std::endl;
+                }
+            }
+        }
+
+        std::cerr << name << ": " << checked - failed << "/" << checked << " decoded as expected" << std::endl;
+        failures += failed;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "aruco_localization/DetectorBackend.h"
+
+// Compares the speed and recall of the detector backends on a directory of
+// images, to pick the fastest engine for a platform.
+//
+// Usage: aruco_detector_benchmark <image directory> [--dictionary ARUCO_MIP_36h12]
+//            [--backends aruco,opencv,apriltag] [--truth truth.csv] [--repeat 3]
+//            [--corner-tolerance 2]
+//
+// The ground truth file has a line per image: file,id,id,... (file name
+// without its directory). Without it, the markers found by any of the
+// backends are taken as the truth, and false positives are not counted.
+//
+// The corners of every marker are also compared with those found by ArUco's
+// stock detector (generic labeler) for the same ID: a marker's corners agree
+// if each is within --corner-tolerance pixels (default 2) of its
+// counterpart, and are turned if they only agree after a cyclic shift (the
+// wrong corner first, which turns the marker's pose).
+
+namespace fs = std::experimental::filesystem;
+
+typedef std::map<std::string, std::set<int>> IdsPerImage;
+typedef std::map<int, std::vector<cv::Point2f>> CornersPerId;
+
+// The cyclic shift of `corners` that matches `reference` within `tolerance`
+// pixels (0 if they agree as they are), or -1 if there is none
+static int cornerShift(const std::vector<cv::Point2f>& corners, const std::vector<cv::Point2f>& reference, double tolerance) {
+    if (corners.size() != 4 || reference.size() != 4) return -1;
+
+    for (int shift=0; shift<4; ++shift) {
+        bool agree = true;
+        for (int k=0; k<4 && agree; ++k) {
+            cv::Point2f d = corners[(k + shift) % 4] - reference[k];
+            agree = std::sqrt(d.x*d.x + d.y*d.y) <= tolerance;
+        }
+        if (agree) return shift;
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <image directory> [--dictionary D] [--backends aruco,opencv,apriltag]"
+                  << " [--truth truth.csv] [--repeat 3] [--corner-tolerance 2]" << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::string> args;
+    for (int i=2; i+1<argc; i+=2)
+        args[argv[i]] = argv[i+1];
+
+    auto arg = [&args](const std::string& key, const std::string& def) {
+        return args.count(key) ? args[key] : def;
+    };
+
+    aruco_localizer::DetectorBackend::Options options;
+    options.dictionary = arg("--dictionary", "ARUCO_MIP_36h12");
+    const int repeat = std::max(1, std::atoi(arg("--repeat", "3").c_str()));
+    const double cornerTolerance = std::atof(arg("--corner-tolerance", "2").c_str());
+
+    std::vector<std::string> backends;
+    std::stringstream list(arg("--backends", "aruco,opencv,apriltag"));
+    for (std::string name; std::getline(list, name, ',');)
+        backends.push_back(name);
+
+    // All of the images are loaded up front, so that only detection is timed
+    std::vector<std::string> files;
+    for (const auto& entry : fs::directory_iterator(argv[1])) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".pgm" || ext == ".bmp" || ext == ".tif")
+            files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<std::string> names;
+    std::vector<cv::Mat> images;
+    for (const std::string& file : files) {
+        cv::Mat image = cv::imread(file, cv::IMREAD_GRAYSCALE);
+        if (image.empty()) continue;
+        names.push_back(fs::path(file).filename().string());
+        images.push_back(image);
+    }
+
+    if (images.empty()) {
+        std::cerr << "No images in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    IdsPerImage truth;
+    const std::string truthFile = arg("--truth", "");
+    if (!truthFile.empty()) {
+        std::ifstream in(truthFile.c_str());
+        for (std::string line; std::getline(in, line);) {
+            std::stringstream fields(line);
+            std::string name, id;
+            std::getline(fields, name, ',');
+            while (std::getline(fields, id, ','))
+                truth[name].insert(std::atoi(id.c_str()));
+        }
+    }
+
+    // The reference corners, from ArUco's stock detector (not timed)
+    std::vector<CornersPerId> reference(images.size());
+    {
+        aruco_localizer::DetectorBackend::Options stock = options;
+        stock.specializedDecoder = false;
+        std::unique_ptr<aruco_localizer::DetectorBackend> detector = aruco_localizer::DetectorBackend::create("aruco", stock);
+        for (size_t i=0; i<images.size(); ++i)
+            for (const aruco::Marker& marker : detector->detect(images[i]))
+                reference[i][marker.id] = marker;
+    }
+
+    struct Result {
+        std::string name;
+        std::vector<double> ms;     // per frame, best of `repeat`
+        IdsPerImage found;
+        size_t compared, agreed, turned;    // corners, against the reference
+    };
+    std::vector<Result> results;
+
+    for (const std::string& backend : backends) {
+        std::unique_ptr<aruco_localizer::DetectorBackend> detector;
+        try {
+            detector = aruco_localizer::DetectorBackend::create(backend, options);
+        } catch (std::exception& e) {
+            std::cerr << "Skipping " << backend << ": " << e.what() << std::endl;
+            continue;
+        }
+
+        Result result;
+        result.name = detector->getName();
+        result.compared = result.agreed = result.turned = 0;
+
+        detector->detect(images[0]);  // warm up
+
+        for (size_t i=0; i<images.size(); ++i) {
+            double best = 1e9;
+            std::vector<aruco::Marker> markers;
+            for (int r=0; r<repeat; ++r) {
+                auto start = std::chrono::steady_clock::now();
+                markers = detector->detect(images[i]);
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+
+            result.ms.push_back(best);
+            for (const aruco::Marker& marker : markers) {
+                result.found[names[i]].insert(marker.id);
+
+                auto ref = reference[i].find(marker.id);
+                if (ref == reference[i].end()) continue;
+
+                int shift = cornerShift(marker, ref->second, cornerTolerance);
+                result.compared++;
+                if (shift == 0) result.agreed++;
+                else if (shift > 0) result.turned++;
+            }
+        }
+
+        results.push_back(result);
+    }
+
+    // Without ground truth, a marker is real if any backend found it
+    const bool pseudoTruth = truth.empty();
+    if (pseudoTruth) {
+        for (const Result& result : results)
+            for (const auto& image : result.found)
+                truth[image.first].insert(image.second.begin(), image.second.end());
+    }
+
+    size_t total = 0;
+    for (const std::string& name : names)
+        total += truth[name].size();
+
+    std::printf("%zu images, %zu markers%s\n\n", images.size(), total, pseudoTruth ? " (found by any backend)" : "");
+    std::printf("%-32s %10s %10s %10s %8s %8s %10s %8s\n", "backend", "mean ms", "median ms", "fps", "recall", "false+",
+                "corners", "turned");
+
+    for (Result& result : results) {
+        size_t hits = 0, falsePositives = 0;
+        for (const std::string& name : names) {
+            const std::set<int>& expected = truth[name];
+            for (int id : result.found[name]) {
+                if (expected.count(id)) ++hits;
+                else ++falsePositives;
+            }
+        }
+
+        double mean = 0;
+        for (double ms : result.ms) mean += ms;
+        mean /= result.ms.size();
+
+        std::vector<double> sorted = result.ms;
+        std::sort(sorted.begin(), sorted.end());
+        double median = sorted[sorted.size() / 2];
+
+        std::printf("%-32s %10.2f %10.2f %10.1f %7.1f%% ", result.name.c_str(), mean, median, 1000.0 / mean,
+                    total ? 100.0 * hits / total : 100.0);
+        if (pseudoTruth) std::printf("%8s ", "-");
+        else std::printf("%8zu ", falsePositives);
+
+        // Agreeing corners, of the markers the reference also found
+        std::printf("%9.1f%% %8zu\n", result.compared ? 100.0 * result.agreed / result.compared : 100.0, result.turned);
+    }
+
+    return 0;
+}
@@ -5,7 +5,8 @@ namespace aruco_localizer {
 // ----------------------------------------------------------------------------
 
 ArucoLocalizer::ArucoLocalizer() :
-    nh_(ros::NodeHandle()), nh_private_("~"), it_(nh_)
+    nh_(ros::NodeHandle()), nh_private_("~"), it_(nh_),
+    pmu_({ "convert", "quality", "detect", "measure", "map", "output" })
 {
 
     // Read in ROS params
@@ -15,36 +16,212 @@ ArucoLocalizer::ArucoLocalizer() :
     nh_private_.param<bool>("debug_save_input_frames", debugSaveInputFrames_, false);
     nh_private_.param<bool>("debug_save_output_frames", debugSaveOutputFrames_, false);
     nh_private_.param<std::string>("debug_image_path", debugImagePath_, "/tmp/arucoimages");
-
-    // Subscribe to input video feed and publish output video feed
+    nh_private_.param<int>("marker_patch_size", patchSize_, 64);
+    nh_private_.param<int>("stats_period", statsPeriod_, 30);
+    nh_private_.param<bool>("pmu_counters", pmuRequested_, false);
+    nh_private_.param<double>("calibrate_attitude_timeout", attitudeTimeout_, 2.0);
+
+    // Build the marker map from the live stream instead of loading it
+    nh_private_.param<bool>("mapping", mapping_, false);
+    nh_private_.param<int>("mapping_publish_period", mappingPublishPeriod_, 30);
+    nh_private_.param<std::string>("mapping_output", mappingOutput_, debugImagePath_ + "/markermap.yml");
+    mapper_.setMarkerSize(markerSize_);
+    mapper_.setMaxWeight(nh_private_.param<double>("mapping_max_weight", 100.0));
+    mappingFrames_ = 0;
+    mappingRebuildFrame_ = 0;
+
+    // Dead band on the pose outputs, disabled by default
+    nh_private_.param<bool>("deadband", deadBandEnabled_, false);
+    for (DeadBand* deadBand : { &measDeadBand_, &estimateDeadBand_ }) {
+        deadBand->setThresholds(nh_private_.param<double>("deadband_translation", 0.01),
+                                nh_private_.param<double>("deadband_rotation", 1.0)*M_PI/180.0);
+        deadBand->setMaxInterval(nh_private_.param<double>("deadband_max_interval", 1.0));
+    }
+    markerSetChanged_ = true;
+    framesIn_ = frameSeq_ = 0;
+
+    // Keep the last frames in memory, to be dumped when tracking is lost, the
+    // map pose jumps or the dump_blackbox service is called
+    double blackBoxRate = nh_private_.param<double>("blackbox_rate", 30.0);
+    blackBox_.configure(std::lround(nh_private_.param<double>("blackbox_seconds", 0.0) * blackBoxRate),
+                        std::lround(nh_private_.param<double>("blackbox_post_seconds", 1.0) * blackBoxRate),
+                        blackBoxRate,
+                        nh_private_.param<int>("blackbox_max_markers", 64),
+                        nh_private_.param<std::string>("blackbox_path", debugImagePath_ + "/blackbox"));
+    nh_private_.param<bool>("blackbox_on_tracking_loss", blackBoxOnLoss_, true);
+    nh_private_.param<double>("blackbox_jump", blackBoxJump_, 0.5);
+    wasTracked_ = false;
+
+    // Planar pose ambiguity of individual markers
+    poseDisambiguator_.setMinErrorRatio(nh_private_.param<double>("ippe_min_error_ratio", 4.0));
+    poseDisambiguator_.setFlipAngle(nh_private_.param<double>("ippe_flip_angle", 30.0)*M_PI/180.0);
+    poseDisambiguator_.setMaxGap(nh_private_.param<int>("ippe_max_gap", 10));
+
+    // The executor is shared with the other localizers in this process; only
+    // the first one to start decides its size
+    executor_ = &Executor::instance(nh_private_.param<int>("executor_threads", 0));
+    frameBudget_ = std::chrono::duration_cast<Executor::Clock::duration>(
+                std::chrono::duration<double>(nh_private_.param<double>("frame_budget", 0.033)));
+
+    // Tone mapping of mono12/mono16 cameras
+    toneMapper_.setClipFraction(nh_private_.param<double>("tonemap_clip_fraction", 0.005));
+    toneMapper_.setGamma(nh_private_.param<double>("tonemap_gamma", 2.0));
+
+    // Frame quality pre-check, disabled by default
+    nh_private_.param<bool>("quality_check", qualityCheck_, false);
+    frameQuality_.setDecimation(nh_private_.param<int>("quality_decimation", 4));
+
+    // Band-wise preprocessing, which produces the sampled frame for the quality check as well
+    nh_private_.param<bool>("band_preprocessing", bandPreprocessing_, false);
+    preprocessor_.setDecimation(nh_private_.param<int>("quality_decimation", 4));
+    preprocessor_.setBandBytes(nh_private_.param<int>("band_bytes", 128*1024));
+    frameQuality_.setMinSharpness(nh_private_.param<double>("quality_min_sharpness", 20.0));
+    frameQuality_.setBrightnessLimits(nh_private_.param<double>("quality_min_brightness", 20.0),
+                                      nh_private_.param<double>("quality_max_brightness", 235.0));
+
+    // Subscribe to input video feed (from image_transport, or a shared memory frame
+    // ring with the camera info still coming from ROS) and publish output video feed
+    std::string frameSource = nh_private_.param<std::string>("frame_source", "image_transport");
+    nh_private_.param<std::string>("frame_ring", frameRingName_, "/aruco_frames");
     it_ = image_transport::ImageTransport(nh_);
-    image_sub_ = it_.subscribeCamera("input_image", 1, &ArucoLocalizer::cameraCallback, this);
+    if (frameSource == "shm")
+        cinfo_sub_ = nh_.subscribe("camera_info", 1, &ArucoLocalizer::cameraInfoCallback, this);
+    else
+        image_sub_ = it_.subscribeCamera("input_image", 1, &ArucoLocalizer::cameraCallback, this);
     image_pub_ = it_.advertise("output_image", 1);
 
     // Create ROS publishers
     estimate_pub_ = nh_private_.advertise<geometry_msgs::PoseStamped>("estimate", 1);
+    estimate_seq_pub_ = nh_private_.advertise<aruco_localization::MarkerMapEstimate>("estimate_seq", 1);
     meas_pub_ = nh_private_.advertise<aruco_localization::MarkerMeasurementArray>("measurements", 1);
+    patch_pub_ = nh_private_.advertise<aruco_localization::MarkerPatchArray>("marker_patches", 1);
+    stats_pub_ = nh_private_.advertise<aruco_localization::LocalizerStats>("stats", 1);
+
+    // Streaming outputs: the corners right after detection, then every marker as soon as its pose is known
+    nh_private_.param<bool>("stream_measurements", streamMeasurements_, false);
+    if (streamMeasurements_) {
+        corners_pub_ = nh_private_.advertise<aruco_localization::MarkerCornersArray>("marker_corners", 1);
+        marker_pub_ = nh_private_.advertise<aruco_localization::MarkerMeasurementStamped>("marker_measurement", 16);
+    }
+
+    // Publish on a thread of its own, fed through a lock-free queue
+    nh_private_.param<bool>("async_publish", asyncPublish_, false);
+    output_ = &syncOutput_;
+    stopPublisher_ = false;
+    if (asyncPublish_) {
+        outputs_.reset(std::max(nh_private_.param<int>("publish_queue_size", 8), 1));
+        publisherThread_ = std::thread(&ArucoLocalizer::publisherLoop, this);
+    }
 
     // Create ROS services
     calib_attitude_ = nh_private_.advertiseService("calibrate_attitude", &ArucoLocalizer::calibrateAttitude, this);
+    dump_blackbox_ = nh_private_.advertiseService("dump_blackbox", &ArucoLocalizer::dumpBlackBox, this);
+    if (mapping_) {
+        map_pub_ = nh_private_.advertise<aruco_localization::MarkerMeasurementArray>("map", 100);
+        save_map_ = nh_private_.advertiseService("save_marker_map", &ArucoLocalizer::saveMarkerMap, this);
+    }
+    update_map_ = nh_private_.advertiseService("update_marker_map", &ArucoLocalizer::updateMarkerMap, this);
 
     //
     // Set up the ArUco detector
     //
 
-    // Set up the Marker Map dimensions, spacing, dictionary, etc from the YAML
-    mmConfig_.readFromFile(mmConfigFile);
+    std::string dictionary;
+    aruco::MarkerMap mmConfig;
+    std::string subMapConfigFile = nh_private_.param<std::string>("submap_config", "");
+    if (!subMapConfigFile.empty()) {
+        // A partitioned map: its zones are paged in as the camera moves
+        subMaps_.setMargin(nh_private_.param<double>("submap_margin", 1.0));
+        subMaps_.load(subMapConfigFile, markerSize_);
+        dictionary = subMaps_.getDictionary();
+    } else if (mapping_) {
+        // The map is built from the live stream, starting out empty
+        dictionary = nh_private_.param<std::string>("mapping_dictionary", "ARUCO_MIP_36h12");
+        mmConfig.mInfoType = aruco::MarkerMap::METERS;
+        mmConfig.setDictionary(dictionary);
+        mapDictionary_ = dictionary;
+    } else {
+        // Set up the Marker Map dimensions, spacing, dictionary, etc from the YAML
+        mmConfig.readFromFile(mmConfigFile);
+        dictionary = mmConfig.getDictionary();
+    }
 
-    // Prepare the marker detector by:
-    // (1) setting the dictionary we are using
-    mDetector_.setDictionary(mmConfig_.getDictionary());
-    // (2) setting the corner refinement method
-    // ... TODO -- make this corner sub pix or something
-    mDetector_.setCornerRefinementMethod(aruco::MarkerDetector::LINES);
+    // Prepare the marker detector, with the backend (detection engine) of choice
+    detectorOptions_.dictionary = dictionary;
+    detectorOptions_.specializedDecoder = nh_private_.param<bool>("specialized_decoder", true);
+    detectorOptions_.errorCorrectionRate = nh_private_.param<double>("decoder_error_correction_rate", 0.0);
+    nh_private_.param<std::string>("detector_backend", detectorBackend_, "aruco");
+    try {
+        detector_ = DetectorBackend::create(detectorBackend_, detectorOptions_);
+    } catch (std::exception& e) {
+        // std::runtime_error, or cv::Exception from loading the dictionary
+        ROS_WARN("[aruco] %s, using the 'aruco' detector backend.", e.what());
+        detectorBackend_ = "aruco";
+        detector_ = DetectorBackend::create(detectorBackend_, detectorOptions_);
+    }
+    ROS_INFO("[aruco] Detector backend: %s", detector_->getName().c_str());
+
+    // Look for nested marker layouts in the map config
+    if (nestedDetector_.load(subMapConfigFile.empty() ? mmConfigFile : subMapConfigFile) > 0) {
+        nestedDetector_.setDecimation(nh_private_.param<int>("nested_decimation", 4));
+        nestedDetector_.setMinInnerPerimeter(nh_private_.param<double>("nested_min_inner_perimeter", 400.0));
+    }
+
+    // Consecutive frames can be detected on several threads, each with its own
+    // detector. Tracking and publishing stay on one thread, in frame order.
+    int frameWorkers = nh_private_.param<int>("frame_workers", 0);
+    if (frameWorkers > 0) {
+        frontEnds_.resize(frameWorkers);
+        for (FrontEnd& frontEnd : frontEnds_) {
+            frontEnd.detector = DetectorBackend::create(detectorBackend_, detectorOptions_);
+            frontEnd.nested = nestedDetector_;
+            frontEnd.quality = frameQuality_;
+        }
+
+        int capacity = nh_private_.param<int>("frame_reorder_capacity", 2*frameWorkers);
+        frameWorkers_.start(frameWorkers, std::max(capacity, frameWorkers),
+            [this](size_t worker, FrameJob& job) {
+                FrontEnd& frontEnd = frontEnds_[worker];
+                runFrontEnd(job, *frontEnd.detector, frontEnd.nested, frontEnd.quality, nullptr);
+            },
+            [this](FrameJob& job) { finishFrame(job); });
+    }
 
     // set markmap size. Convert to meters if necessary
-    if (mmConfig_.isExpressedInPixels())
-        mmConfig_ = mmConfig_.convertToMeters(markerSize_);
+    if (mmConfig.isExpressedInPixels())
+        mmConfig = mmConfig.convertToMeters(markerSize_);
+
+    // The map can be edited at runtime (through the update_marker_map service)
+    mmConfig_.reset(mmConfig);
+    trackerMapVersion_ = 0;
+
+    // Pick the variant of the processing pipeline that only does what is needed
+    std::string pipelineMode = nh_private_.param<std::string>("pipeline_mode", "full");
+    if (mapping_ && pipelineMode != "full") {
+        ROS_WARN("[aruco] Mapping needs the marker poses, using pipeline_mode 'full'.");
+        pipelineMode = "full";
+    }
+    pipeline_ = selectPipeline(pipelineMode, showOutputVideo_, qualityCheck_, nh_private_.param<bool>("compute_euler", true));
+
+    // To measure what the variants gain over the generic pipeline, e.g., over a recorded bag
+    nh_private_.param<int>("pipeline_timing", pipelineTiming_, 0);
+    genericFlags_ = 0;
+    pipelineTimingFrame_ = 0;
+    if (pipelineTiming_ > 0) {
+        for (const char* mode : { "full", "detect_only", "map_only" }) {
+            if (mapping_ && mode != pipelineMode) continue;
+            for (int draw=0; draw<2; ++draw) {
+                for (int euler=0; euler<2; ++euler) {
+                    PipelineTiming timing;
+                    timing.name = mode + std::string(draw ? " draw" : "") + (qualityCheck_ ? " filter" : "") + (euler ? " euler" : "");
+                    timing.flags = pipelineFlags(mode, draw, qualityCheck_, euler);
+                    timing.pipeline = selectPipeline(mode, draw, qualityCheck_, euler);
+                    pipelineTimings_.push_back(timing);
+                }
+            }
+        }
+        ROS_WARN("[aruco] Timing %zu pipeline variants, the outputs change from frame to frame.", pipelineTimings_.size());
+    }
 
     // Configuring of Pose Tracker is done once a CameraInfo message has been received.
 
@@ -57,6 +234,28 @@ ArucoLocalizer::ArucoLocalizer() :
 
     // Create the `debug_image_path` if it doesn't exist
     std::experimental::filesystem::create_directories(debugImagePath_);
+
+    // Frames from shared memory are processed on their own thread
+    stopFrameRing_ = false;
+    framesDropped_ = 0;
+    if (frameSource == "shm")
+        frameRingThread_ = std::thread(&ArucoLocalizer::frameRingLoop, this);
+}
+
+// ----------------------------------------------------------------------------
+
+ArucoLocalizer::~ArucoLocalizer() {
+    stopFrameRing_ = true;
+    if (frameRingThread_.joinable())
+        frameRingThread_.join();
+
+    frameWorkers_.stop();
+
+    // The frames that are already through are still published
+    stopPublisher_ = true;
+    publisherWake_.notify_one();
+    if (publisherThread_.joinable())
+        publisherThread_.join();
 }
 
 // ----------------------------------------------------------------------------
@@ -65,9 +264,19 @@ ArucoLocalizer::ArucoLocalizer() :
 
 bool ArucoLocalizer::calibrateAttitude(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
 
-    // Get the latest attitude in the body frame (is this in the body frame?)
+    // Get the latest attitude in the body frame (is this in the body frame?).
+    // The listener only lives for this call and has its own spin thread, so
+    // it can fill its buffer while this (service) callback waits.
     tf::StampedTransform transform;
-    tf_listener_.lookupTransform("base", "chiny", ros::Time(0), transform);
+    try {
+        tf::TransformListener listener(nh_);
+        listener.waitForTransform("base", "chiny", ros::Time(0), ros::Duration(attitudeTimeout_));
+        listener.lookupTransform("base", "chiny", ros::Time(0), transform);
+    } catch (tf::TransformException& e) {
+        res.success = false;
+        res.message = e.what();
+        return true;
+    }
 
     // Store the old bias correction term to correctly capture the original biased attitude
     tf::Quaternion q0(quat_att_bias_.x() ,quat_att_bias_.y(), quat_att_bias_.z(), quat_att_bias_.w());
@@ -86,6 +295,77 @@ bool ArucoLocalizer::calibrateAttitude(std_srvs::Trigger::Request &req, std_srvs
 
 // ----------------------------------------------------------------------------
 
+bool ArucoLocalizer::dumpBlackBox(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
+    if (!blackBox_.isEnabled()) {
+        res.success = false;
+        res.message = "The black box is disabled (blackbox_seconds is 0).";
+    } else if (!blackBox_.trigger("service")) {
+        res.success = false;
+        res.message = "A dump is already in progress.";
+    } else {
+        res.success = true;
+        res.message = "The black box will be written to disk after the post-trigger frames.";
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+bool ArucoLocalizer::updateMarkerMap(aruco_localization::UpdateMarkerMap::Request &req, aruco_localization::UpdateMarkerMap::Response &res) {
+    if (subMaps_.isEnabled() || mapping_) {
+        res.success = false;
+        res.message = "Partitioned maps (submap_config) and maps that are being built (mapping) can not be edited.";
+        return true;
+    }
+
+    std::vector<cv::Point3f> corners;
+    for (const auto& p : req.corners)
+        corners.push_back(cv::Point3f(p.x, p.y, p.z));
+
+    LiveMarkerMap::Operation op;
+    switch (req.operation) {
+        case aruco_localization::UpdateMarkerMap::Request::INSERT: op = LiveMarkerMap::INSERT; break;
+        case aruco_localization::UpdateMarkerMap::Request::UPDATE: op = LiveMarkerMap::UPDATE; break;
+        case aruco_localization::UpdateMarkerMap::Request::REMOVE: op = LiveMarkerMap::REMOVE; break;
+        default:
+            res.success = false;
+            res.message = "Unknown operation " + std::to_string(req.operation) + ", expected INSERT (0), UPDATE (1) or REMOVE (2).";
+            res.map_size = mmConfig_.get()->map.size();
+            return true;
+    }
+
+    // The frame being processed keeps using the map it started with
+    res.success = mmConfig_.apply(op, req.aruco_ids, corners, res.message);
+    res.map_size = mmConfig_.get()->map.size();
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+bool ArucoLocalizer::saveMarkerMap(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
+    aruco::MarkerMap map;
+    {
+        std::lock_guard<std::mutex> lock(mapperMutex_);
+        map = mapper_.toMarkerMap(mapDictionary_);
+    }
+
+    try {
+        map.saveToFile(mappingOutput_);
+    } catch (cv::Exception& e) {
+        res.success = false;
+        res.message = e.what();
+        return true;
+    }
+
+    res.success = true;
+    res.message = "Saved " + std::to_string(map.size()) + " markers to " + mappingOutput_;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 void ArucoLocalizer::sendtf(const cv::Mat& rvec, const cv::Mat& tvec) {
 
     // We want all transforms to use the same exact time
@@ -94,117 +374,535 @@ void ArucoLocalizer::sendtf(const cv::Mat& rvec, const cv::Mat& tvec) {
     // Create the transform from the camera to the ArUco Marker Map
     tf::Transform transform = aruco2tf(rvec, tvec);
 
-    //
-    // Link the aruco (parent) to the camera (child) frames
-    //
+    // Skip poses that are (almost) the same as the last one published
+    if (deadBandEnabled_) {
+        deadBandPoses_.resize(1);
+        deadBandPoses_[0].key = -1;
+        deadBandPoses_[0].position = transform.getOrigin();
+        deadBandPoses_[0].orientation = transform.getRotation();
 
-    // Note that `transform` is a measurement of the ArUco map w.r.t the camera,
-    // therefore the inverse gives the transform from `aruco` to `camera`.
-    tf_br_.sendTransform(tf::StampedTransform(transform.inverse(), now, "aruco", "camera"));
+        if (!estimateDeadBand_.update(deadBandPoses_, now, markerSetChanged_))
+            return;
+    }
 
-    //
-    // Publish measurement of the pose of the ArUco board w.r.t the camera frame
-    //
+    // Broadcast and published with the rest of the frame's outputs
+    output_->estimate = true;
+    output_->transform = transform;
+    output_->stamp = now;
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::updateMarkerSet(const Detections& markers) {
+    std::swap(markerIds_, lastMarkerIds_);
 
-    geometry_msgs::PoseStamped poseMsg;
-    tf::poseTFToMsg(transform, poseMsg.pose);
-    poseMsg.header.frame_id = "camera";
-    poseMsg.header.stamp = now;
-    estimate_pub_.publish(poseMsg);
+    markerIds_.assign(markers.ids.begin(), markers.ids.end());
+    std::sort(markerIds_.begin(), markerIds_.end());
+
+    markerSetChanged_ = markerIds_ != lastMarkerIds_;
 }
 
 // ----------------------------------------------------------------------------
 
-void ArucoLocalizer::processImage(cv::Mat& frame, bool drawDetections) {
+template <unsigned Flags>
+void ArucoLocalizer::processImage(FrameJob& job) {
+
+    // Stages that are not part of this variant are compiled out (except in
+    // the generic variant, which checks them for every frame)
+    const bool drawDetections = hasStage<Flags>(PIPE_DRAW);
 
-    // Detection of the board
-    std::vector<aruco::Marker> detected_markers = mDetector_.detect(frame);
+    cv::Mat& frame = job.image->image;
+
+    // Quality check and detection, unless a frame worker already did them
+    if (!job.detected)
+        runFrontEnd(job, *detector_, nestedDetector_, frameQuality_, &pmu_);
+
+    // Skip frames that are too blurred or badly exposed to be of any use
+    if (hasStage<Flags>(PIPE_FILTER) && !checkFrameQuality(job)) return;
+
+    // Detection works on the gray frame if it was already made
+    const cv::Mat& input = bandPreprocessing_ ? job.gray : frame;
+    std::vector<aruco::Marker>& detected_markers = job.markers;
+    Detections& det = job.detections;
+
+    if (deadBandEnabled_) updateMarkerSet(det);
+
+    if (blackBox_.isEnabled()) blackBox_.setDetections(det);
+
+    if (streamMeasurements_ && corners_pub_.getNumSubscribers() > 0)
+        publishMarkerCorners(det);
+
+    // Marker patches are only generated if someone is listening, and before
+    // anything is drawn on the frame
+    if (patch_pub_.getNumSubscribers() > 0)
+        publishMarkerPatches(input, det);
 
     if (drawDetections) {
         // print the markers detected that belongs to the markerset
-        for (auto idx : mmConfig_.getIndices(detected_markers))
-            detected_markers[idx].draw(frame, cv::Scalar(0, 0, 255), 1);
+        if (subMaps_.isEnabled()) {
+            for (auto& marker : detected_markers)
+                marker.draw(frame, cv::Scalar(0, 0, 255), 1);
+        } else {
+            for (auto idx : mapState_->map.getIndices(detected_markers))
+                detected_markers[idx].draw(frame, cv::Scalar(0, 0, 255), 1);
+        }
     }
 
     //
     // Calculate pose of each individual marker w.r.t the camera
     //
 
-    aruco_localization::MarkerMeasurementArray measurement_msg;
-    measurement_msg.header.frame_id = "camera";
-    measurement_msg.header.stamp = ros::Time::now();
-
-    for (auto marker : detected_markers) {
-        // Create Tvec, Rvec based on the camera and marker geometry
-        marker.calculateExtrinsics(markerSize_, camParams_, false);
-
-        // Create the ROS pose message and add to the array
-        aruco_localization::MarkerMeasurement msg;
-        msg.position.x = marker.Tvec.at<float>(0);
-        msg.position.y = marker.Tvec.at<float>(1);
-        msg.position.z = marker.Tvec.at<float>(2);
-
-        // Represent Rodrigues parameters as a quaternion
-        tf::Quaternion quat = rodriguesToTFQuat(marker.Rvec);
-        tf::quaternionTFToMsg(quat, msg.orientation);
+    if (hasStage<Flags>(PIPE_MEASURE)) {
+        pmu_.begin(STAGE_MEASURE);
+
+        // Filled in straight into the frame's outputs, reusing the poses' capacity
+        aruco_localization::MarkerMeasurementArray& measurement_msg = output_->measurement_msg;
+        measurement_msg.poses.clear();
+        measurement_msg.header.frame_id = "camera";
+        measurement_msg.header.stamp = ros::Time::now();
+        measurement_msg.frame_seq = frameSeq_;
+
+        poseDisambiguator_.nextFrame();
+        mapObservations_.clear();
+
+        // Each marker's measurement, in index order
+        auto measure = [this, &det, &measurement_msg](size_t i) {
+            aruco_localization::MarkerMeasurement msg;
+
+            // attach the ArUco ID to this measurement
+            msg.aruco_id = det.ids[i];
+
+            if (hasStage<Flags>(PIPE_POSES)) {
+                if (!det.solved[i]) return;
+
+                // Pick the solution that is consistent with the previous frame
+                det.flipped[i] = poseDisambiguator_.select(det.ids[i], candidates_[i], det.rvecs[i], det.tvecs[i], det.errors[i]);
+                msg.pose_flipped = det.flipped[i];
+
+                // Poses that flipped w.r.t. the previous frame are likely wrong, and kept out of the map
+                if (mapping_ && !msg.pose_flipped)
+                    mapObservations_.push_back({ det.ids[i], aruco2tf(det.rvecs[i], det.tvecs[i]) });
+
+                // Create the ROS pose message and add to the array
+                msg.position.x = det.tvecs[i][0];
+                msg.position.y = det.tvecs[i][1];
+                msg.position.z = det.tvecs[i][2];
+
+                // Represent Rodrigues parameters as a quaternion
+                tf::Quaternion quat = rodriguesToTFQuat(det.rvecs[i]);
+                tf::quaternionTFToMsg(quat, msg.orientation);
+
+                if (hasStage<Flags>(PIPE_EULER)) {
+                    // Extract Euler angles
+                    double r, p, y;
+                    tf::Matrix3x3(quat).getRPY(r,p,y);
+
+                    msg.euler.x = r*180/M_PI;
+                    msg.euler.y = p*180/M_PI;
+                    msg.euler.z = y*180/M_PI;
+                }
+            } else {
+                // Detections only, the pose is left as identity
+                msg.orientation.w = 1;
+            }
+
+            measurement_msg.poses.push_back(msg);
+
+            // Streamed right away, without waiting for the other markers (or the dead band)
+            if (hasStage<Flags>(PIPE_POSES) && streamMeasurements_) {
+                aruco_localization::MarkerMeasurementStamped marker_msg;
+                marker_msg.header = measurement_msg.header;
+                marker_msg.frame_seq = frameSeq_;
+                marker_msg.measurement = msg;
+                marker_pub_.publish(marker_msg);
+            }
+        };
+
+        if (hasStage<Flags>(PIPE_POSES)) {
+            // Find both planar pose solutions of each marker based on the camera and
+            // marker geometry. Markers are independent, so this is done in parallel,
+            // and each marker is measured (and streamed) as soon as it and the ones
+            // before it are solved, while the others are still being solved.
+            candidates_.resize(det.size());
+
+            executor_->parallelForOrdered(det.size(), [this, &det](size_t i) {
+                det.solved[i] = PoseDisambiguator::solve(det.cornersOf(i), markerSize_, camParams_, candidates_[i]);
+            }, measure, Executor::Clock::now() + frameBudget_);
+        } else {
+            for (size_t i=0; i<det.size(); ++i)
+                measure(i);
+        }
 
-        // Extract Euler angles
-        double r, p, y;
-        tf::Matrix3x3(quat).getRPY(r,p,y);
+        // With the dead band, only publish if a marker moved, appeared or disappeared
+        bool publish = true;
+        if (deadBandEnabled_) {
+            deadBandPoses_.resize(measurement_msg.poses.size());
+            for (size_t i=0; i<measurement_msg.poses.size(); ++i) {
+                const aruco_localization::MarkerMeasurement& m = measurement_msg.poses[i];
+                deadBandPoses_[i].key = m.aruco_id;
+                tf::pointMsgToTF(m.position, deadBandPoses_[i].position);
+                tf::quaternionMsgToTF(m.orientation, deadBandPoses_[i].orientation);
+            }
+
+            publish = measDeadBand_.update(deadBandPoses_, measurement_msg.header.stamp, markerSetChanged_);
+        }
 
-        msg.euler.x = r*180/M_PI;
-        msg.euler.y = p*180/M_PI;
-        msg.euler.z = y*180/M_PI;
+        output_->measurements = publish;
 
-        // attach the ArUco ID to this measurement
-        msg.aruco_id = marker.id;
+        if (hasStage<Flags>(PIPE_POSES) && mapping_) updateMarkerMapping();
 
-        measurement_msg.poses.push_back(msg);
+        pmu_.end(STAGE_MEASURE);
     }
 
-    meas_pub_.publish(measurement_msg);
-
     //
     // Calculate pose of the entire marker map w.r.t the camera
     //
 
-    // If the Pose Tracker was properly initialized, find 3D pose information
-    if (mmPoseTracker_.isValid()) {
-        if (mmPoseTracker_.estimatePose(detected_markers)) {
+    if (hasStage<Flags>(PIPE_MAP)) {
+        pmu_.begin(STAGE_MAP);
+
+        bool tracked = false;
+        cv::Mat tvec;
+
+        if (subMaps_.isEnabled()) {
+            // Only the active zone (and its neighbors) of a partitioned map are considered
+            if (subMaps_.estimatePose(detected_markers)) {
+                tracked = true;
+                tvec = subMaps_.getTvec();
 
-            if (drawDetections)
-                aruco::CvDrawingUtils::draw3dAxis(frame, camParams_, mmPoseTracker_.getRvec(), mmPoseTracker_.getTvec(), mmConfig_[0].getMarkerSize()*2);
+                if (drawDetections)
+                    aruco::CvDrawingUtils::draw3dAxis(frame, camParams_, subMaps_.getRvec(), subMaps_.getTvec(), subMaps_.getMarkerSize()*2);
 
-            sendtf(mmPoseTracker_.getRvec(), mmPoseTracker_.getTvec());
+                sendtf(subMaps_.getRvec(), subMaps_.getTvec());
+            }
         }
+
+        // If the Pose Tracker was properly initialized, find 3D pose information
+        else if (mmPoseTracker_.isValid()) {
+            if (mmPoseTracker_.estimatePose(detected_markers)) {
+                tracked = true;
+                tvec = mmPoseTracker_.getTvec();
+
+                if (drawDetections)
+                    aruco::CvDrawingUtils::draw3dAxis(frame, camParams_, mmPoseTracker_.getRvec(), mmPoseTracker_.getTvec(), mapState_->map[0].getMarkerSize()*2);
+
+                sendtf(mmPoseTracker_.getRvec(), mmPoseTracker_.getTvec());
+            }
+        }
+
+        if (blackBox_.isEnabled()) checkBlackBoxTriggers(tracked, tvec);
+
+        pmu_.end(STAGE_MAP);
     }
 
 }
 
 // ----------------------------------------------------------------------------
 
+template <unsigned Mode>
+ArucoLocalizer::Pipeline ArucoLocalizer::selectPipeline(bool draw, bool filter, bool euler) {
+    // Every combination of the options is its own specialization of processImage()
+    switch ((draw ? PIPE_DRAW : 0) | (filter ? PIPE_FILTER : 0) | (euler ? PIPE_EULER : 0)) {
+        case 0:                                     return &ArucoLocalizer::processImage<Mode>;
+        case PIPE_DRAW:                             return &ArucoLocalizer::processImage<Mode | PIPE_DRAW>;
+        case PIPE_FILTER:                           return &ArucoLocalizer::processImage<Mode | PIPE_FILTER>;
+        case PIPE_DRAW | PIPE_FILTER:               return &ArucoLocalizer::processImage<Mode | PIPE_DRAW | PIPE_FILTER>;
+        case PIPE_EULER:                            return &ArucoLocalizer::processImage<Mode | PIPE_EULER>;
+        case PIPE_DRAW | PIPE_EULER:                return &ArucoLocalizer::processImage<Mode | PIPE_DRAW | PIPE_EULER>;
+        case PIPE_FILTER | PIPE_EULER:              return &ArucoLocalizer::processImage<Mode | PIPE_FILTER | PIPE_EULER>;
+        default:                                    return &ArucoLocalizer::processImage<Mode | PIPE_DRAW | PIPE_FILTER | PIPE_EULER>;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+ArucoLocalizer::Pipeline ArucoLocalizer::selectPipeline(const std::string& mode, bool draw, bool filter, bool euler) {
+    if (mode == "detect_only")
+        return selectPipeline<PIPE_MEASURE>(draw, filter, euler);
+
+    if (mode == "map_only")
+        return selectPipeline<PIPE_MAP>(draw, filter, euler);
+
+    if (mode != "full")
+        ROS_WARN("[aruco] Unknown pipeline_mode '%s', using 'full'.", mode.c_str());
+
+    return selectPipeline<PIPE_MEASURE | PIPE_POSES | PIPE_MAP>(draw, filter, euler);
+}
+
+// ----------------------------------------------------------------------------
+
+unsigned ArucoLocalizer::pipelineFlags(const std::string& mode, bool draw, bool filter, bool euler) {
+    unsigned flags = (draw ? PIPE_DRAW : 0) | (filter ? PIPE_FILTER : 0) | (euler ? PIPE_EULER : 0);
+
+    if (mode == "detect_only") return flags | PIPE_MEASURE;
+    if (mode == "map_only") return flags | PIPE_MAP;
+    return flags | PIPE_MEASURE | PIPE_POSES | PIPE_MAP;
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::timePipelines(FrameJob& job) {
+
+    // Every other frame goes through the generic variant with the same stages
+    PipelineTiming& timing = pipelineTimings_[(pipelineTimingFrame_ / 2) % pipelineTimings_.size()];
+    const bool generic = pipelineTimingFrame_ % 2 == 1;
+    pipelineTimingFrame_++;
+
+    genericFlags_ = timing.flags;
+    Pipeline pipeline = generic ? &ArucoLocalizer::processImage<PIPE_GENERIC> : timing.pipeline;
+
+    // The front end is the same for every variant, and not part of the times
+    if (!job.detected)
+        runFrontEnd(job, *detector_, nestedDetector_, frameQuality_, &pmu_);
+
+    auto start = std::chrono::steady_clock::now();
+    (this->*pipeline)(job);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    (generic ? timing.genericMs : timing.specializedMs).push_back(ms);
+
+    if (pipelineTimingFrame_ % (2 * pipelineTimings_.size() * pipelineTiming_) != 0) return;
+
+    auto median = [](std::vector<double>& ms) {
+        std::nth_element(ms.begin(), ms.begin() + ms.size()/2, ms.end());
+        return ms[ms.size()/2];
+    };
+
+    ROS_INFO("[aruco] Pipeline variants, median ms per frame over %d frames each:", pipelineTiming_);
+    ROS_INFO("[aruco] %-32s %10s %10s %8s", "variant", "variant", "generic", "gain");
+    for (PipelineTiming& t : pipelineTimings_) {
+        double variant = median(t.specializedMs), genericMedian = median(t.genericMs);
+        ROS_INFO("[aruco] %-32s %10.3f %10.3f %7.1f%%", t.name.c_str(), variant, genericMedian,
+                 genericMedian > 0 ? 100.0 * (genericMedian - variant) / genericMedian : 0.0);
+        t.specializedMs.clear();
+        t.genericMs.clear();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 void ArucoLocalizer::cameraCallback(const sensor_msgs::ImageConstPtr& image, const sensor_msgs::CameraInfoConstPtr& cinfo) {
 
+    // The counters belong to the thread that finishes the frames, which is
+    // this one unless there are frame workers
+    StageCounters* pmu = frameWorkers_.isRunning() ? nullptr : &pmu_;
+    if (pmu) openPmu();
+
+    if (pmu) pmu->begin(STAGE_CONVERT);
+
     cv_bridge::CvImagePtr cv_ptr;
     try {
-        cv_ptr = cv_bridge::toCvCopy(image, sensor_msgs::image_encodings::BGR8);
+        cv_ptr = convertImage(image);
     } catch (cv_bridge::Exception& e) {
         ROS_ERROR("cv_bridge exception: %s", e.what());
+        if (pmu) pmu->end(STAGE_CONVERT);
         return;
     }
 
+    if (pmu) pmu->end(STAGE_CONVERT);
+
+    processFrame(cv_ptr, cinfo);
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& cinfo) {
+    std::lock_guard<std::mutex> lock(cinfoMutex_);
+    cinfo_ = cinfo;
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::frameRingLoop() {
+
+    StageCounters* pmu = frameWorkers_.isRunning() ? nullptr : &pmu_;
+    if (pmu) openPmu();
+
+    uint64_t last = 0, lastSkipped = 0;
+    auto lastFrame = std::chrono::steady_clock::now();
+    while (ros::ok() && !stopFrameRing_) {
+
+        // (Re)attach once the producer has created the ring
+        if (!frameRing_.isOpen()) {
+            try {
+                frameRing_.attach(frameRingName_);
+            } catch (std::runtime_error& e) {
+                ROS_WARN_THROTTLE(5, "[aruco] Waiting for frames: %s", e.what());
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            last = 0;
+            lastFrame = std::chrono::steady_clock::now();
+        }
+
+        FrameRing::Frame ringFrame;
+        if (!frameRing_.acquire(last, ringFrame)) {
+            // A restarted producer writes into a new ring, which starts over at
+            // sequence number 1: re-attach if no frames came for a while because
+            // this one was replaced
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastFrame > std::chrono::seconds(1)) {
+                lastFrame = now;
+                if (frameRing_.replaced()) {
+                    ROS_WARN("[aruco] The frame ring %s was replaced, re-attaching.", frameRingName_.c_str());
+                    frameRing_.detach();
+                    continue;
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        lastFrame = std::chrono::steady_clock::now();
+
+        // The sequence numbers of the slots that the producer skipped were
+        // never frames
+        if (last != 0 && ringFrame.seq > last + 1)
+            framesDropped_ += (ringFrame.seq - last - 1) - (ringFrame.skipped - lastSkipped);
+        last = ringFrame.seq;
+        lastSkipped = ringFrame.skipped;
+
+        sensor_msgs::CameraInfoConstPtr cinfo;
+        {
+            std::lock_guard<std::mutex> lock(cinfoMutex_);
+            cinfo = cinfo_;
+        }
+
+        if (cinfo) {
+            if (pmu) pmu->begin(STAGE_CONVERT);
+
+            cv_bridge::CvImagePtr cv_ptr(new cv_bridge::CvImage);
+            cv_ptr->header.frame_id = cinfo->header.frame_id;
+            cv_ptr->header.stamp.fromNSec(ringFrame.stamp);
+
+            // The pixels stay in shared memory, unless they are going to be drawn on or
+            // published after the slot was released
+            cv::Mat shared(ringFrame.height, ringFrame.width, ringFrame.type, const_cast<uint8_t*>(ringFrame.data), ringFrame.step);
+            if (shared.type() == CV_16UC1) {
+                cv_ptr->encoding = sensor_msgs::image_encodings::MONO8;
+                toneMapper_.apply(shared, cv_ptr->image);
+            } else {
+                cv_ptr->encoding = (shared.channels() == 3) ? sensor_msgs::image_encodings::BGR8 : sensor_msgs::image_encodings::MONO8;
+                if (showOutputVideo_ || frameWorkers_.isRunning() || asyncPublish_ || pipelineTiming_ > 0) shared.copyTo(cv_ptr->image);
+                else cv_ptr->image = shared;
+            }
+
+            if (pmu) pmu->end(STAGE_CONVERT);
+
+            processFrame(cv_ptr, cinfo);
+        }
+
+        frameRing_.release(ringFrame);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::processFrame(const cv_bridge::CvImagePtr& cv_ptr, const sensor_msgs::CameraInfoConstPtr& cinfo) {
+
+    // With frame workers, the job is finished by the pool once it was detected
+    FrameJob* job = frameWorkers_.isRunning() ? frameWorkers_.acquire() : &job_;
+    if (!job) return;
+
+    job->seq = ++framesIn_;
+    job->image = cv_ptr;
+    job->cinfo = cinfo;
+    job->detected = false;
+
+    if (frameWorkers_.isRunning())
+        frameWorkers_.submit();
+    else
+        finishFrame(*job);
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::runFrontEnd(FrameJob& job, DetectorBackend& detector, NestedMarkerDetector& nested,
+                                 FrameQuality& quality, StageCounters* pmu) {
+
+    const cv::Mat& frame = job.image->image;
+
+    // The sampled frame is only made for the quality check
+    if (bandPreprocessing_) {
+        if (pmu) pmu->begin(STAGE_CONVERT);
+        preprocessor_.process(frame, job.gray, qualityCheck_ ? &job.sampled : nullptr,
+                              *executor_, Executor::Clock::now() + frameBudget_);
+        if (pmu) pmu->end(STAGE_CONVERT);
+    }
+
+    job.verdict = FrameQuality::GOOD;
+    if (qualityCheck_) {
+        if (pmu) pmu->begin(STAGE_QUALITY);
+        job.verdict = bandPreprocessing_ ? quality.assessSampled(job.sampled) : quality.assess(frame);
+        job.sharpness = quality.sharpness();
+        job.brightness = quality.brightness();
+        if (pmu) pmu->end(STAGE_QUALITY);
+    }
+
+    // Detection of the board, into the job's markers of earlier frames
+    if (job.verdict == FrameQuality::GOOD) {
+        const cv::Mat& input = bandPreprocessing_ ? job.gray : frame;
+
+        if (pmu) pmu->begin(STAGE_DETECT);
+        if (nested.isEnabled()) nested.detect(input, detector, job.markers);
+        else detector.detect(input, job.markers);
+        if (pmu) pmu->end(STAGE_DETECT);
+    } else {
+        job.markers.clear();
+    }
+    job.detections.assign(job.markers);
+
+    job.detected = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::finishFrame(FrameJob& job) {
+
+    // The counters count the thread that tracks and publishes
+    openPmu();
+
+    const cv_bridge::CvImagePtr& cv_ptr = job.image;
+    const sensor_msgs::CameraInfoConstPtr& cinfo = job.cinfo;
+    frameSeq_ = job.seq;
+
+    // The outputs are filled in straight into the publisher's queue. If it
+    // is full, this frame is still processed but its outputs are dropped.
+    output_ = &syncOutput_;
+    if (asyncPublish_) {
+        output_ = outputs_.back();
+        if (!output_) {
+            stats_.outputs_dropped++;
+            output_ = &syncOutput_;
+        }
+    }
+    output_->seq = frameSeq_;
+    output_->measurements = false;
+    output_->estimate = false;
+    output_->image.reset();
+
     // Configure the Pose Tracker if it has not been configured before
-    if (!mmPoseTracker_.isValid() && mmConfig_.isExpressedInMeters()) {
+    if (!camParams_.isValid()) {
 
         // Extract ROS camera_info (i.e., K and D) for ArUco library
         camParams_ = ros2arucoCamParams(cinfo);
 
-        // Now, if the camera params have been ArUco-ified, set up the tracker
-        if (camParams_.isValid())
-            mmPoseTracker_.setParams(camParams_, mmConfig_);
+        // Now, if the camera params have been ArUco-ified, set up the zone trackers
+        if (camParams_.isValid() && subMaps_.isEnabled())
+            subMaps_.setCameraParams(camParams_);
 
     }
 
+    // The marker map stays the same for the whole frame, and the tracker
+    // follows edits of the map (keeping its pose)
+    mapState_ = mmConfig_.get();
+    if (camParams_.isValid() && !subMaps_.isEnabled() && mapState_->version != trackerMapVersion_) {
+        if (mapState_->map.empty())
+            mmPoseTracker_ = aruco::MarkerMapPoseTracker();
+        else if (mapState_->map.isExpressedInMeters())
+            mmPoseTracker_.setParams(camParams_, mapState_->map);
+        trackerMapVersion_ = mapState_->version;
+    }
+
     // ==========================================================================
     // Process the incoming video frame
 
@@ -213,8 +911,13 @@ void ArucoLocalizer::cameraCallback(const sensor_msgs::ImageConstPtr& image, con
 
     if (debugSaveInputFrames_) saveInputFrame(frame);
 
+    if (blackBox_.isEnabled()) blackBox_.record(frame, cv_ptr->header.stamp);
+
     // Process the image and do ArUco localization on it
-    processImage(frame, showOutputVideo_);
+    if (pipelineTiming_ > 0) timePipelines(job);
+    else (this->*pipeline_)(job);
+
+    updateStats();
 
     if (debugSaveOutputFrames_) saveOutputFrame(frame);
 
@@ -226,8 +929,269 @@ void ArucoLocalizer::cameraCallback(const sensor_msgs::ImageConstPtr& image, con
 
     // ==========================================================================
 
-    // Output modified video stream
-    image_pub_.publish(cv_ptr->toImageMsg());
+    // Output modified video stream, along with everything else
+    pmu_.begin(STAGE_OUTPUT);
+    if (image_pub_.getNumSubscribers() > 0)
+        output_->image = cv_ptr;
+
+    if (output_ != &syncOutput_) {
+        outputs_.push();
+        publisherWake_.notify_one();
+    } else if (!asyncPublish_) {
+        publishOutput(syncOutput_);
+    }
+    pmu_.end(STAGE_OUTPUT);
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::publishOutput(Output& output) {
+
+    if (output.measurements) meas_pub_.publish(output.measurement_msg);
+
+    if (output.estimate) {
+        //
+        // Link the aruco (parent) to the camera (child) frames
+        //
+
+        // Note that `transform` is a measurement of the ArUco map w.r.t the camera,
+        // therefore the inverse gives the transform from `aruco` to `camera`.
+        tf_br_.sendTransform(tf::StampedTransform(output.transform.inverse(), output.stamp, "aruco", "camera"));
+
+        //
+        // Publish measurement of the pose of the ArUco board w.r.t the camera frame
+        //
+
+        geometry_msgs::PoseStamped poseMsg;
+        tf::poseTFToMsg(output.transform, poseMsg.pose);
+        poseMsg.header.frame_id = "camera";
+        poseMsg.header.stamp = output.stamp;
+        estimate_pub_.publish(poseMsg);
+
+        // The same, with the frame's sequence number (roscpp overwrites header.seq)
+        if (estimate_seq_pub_.getNumSubscribers() > 0) {
+            aruco_localization::MarkerMapEstimate estimateMsg;
+            estimateMsg.header = poseMsg.header;
+            estimateMsg.frame_seq = output.seq;
+            estimateMsg.pose = poseMsg.pose;
+            estimate_seq_pub_.publish(estimateMsg);
+        }
+    }
+
+    // The frame is not held on to any longer than needed
+    if (output.image) {
+        image_pub_.publish(output.image->toImageMsg());
+        output.image.reset();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::publisherLoop() {
+    while (true) {
+        Output* output = outputs_.front();
+        if (!output) {
+            if (stopPublisher_) break;
+
+            // A wakeup can be missed (the frame thread does not take the
+            // mutex), which only delays the outputs until the timeout
+            std::unique_lock<std::mutex> lock(publisherMutex_);
+            publisherWake_.wait_for(lock, std::chrono::milliseconds(1));
+            continue;
+        }
+
+        publishOutput(*output);
+        outputs_.pop();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::updateMarkerMapping() {
+    std::lock_guard<std::mutex> lock(mapperMutex_);
+
+    mapper_.update(mapObservations_);
+    ++mappingFrames_;
+
+    // Handing the map to the tracker (which sets itself up again with all of
+    // it on the next frame) costs time in the size of the map, so it is done
+    // at most once per period, right away for the first markers
+    bool due = mappingRebuildFrame_ == 0 || mappingFrames_ - mappingRebuildFrame_ >= static_cast<uint64_t>(mappingPublishPeriod_);
+    if (!due || !mapper_.hasChanges()) return;
+
+    mappingRebuildFrame_ = mappingFrames_;
+    mmConfig_.reset(mapper_.toMarkerMap(mapDictionary_));
+
+    // Only the markers that were added or moved since the last message
+    aruco_localization::MarkerMeasurementArray map_msg;
+    map_msg.header.frame_id = "aruco";
+    map_msg.header.stamp = ros::Time::now();
+    map_msg.frame_seq = frameSeq_;
+
+    for (int id : mapper_.takeChanges()) {
+        const MarkerMapper::Entry& entry = mapper_.getMarkers().at(id);
+        aruco_localization::MarkerMeasurement msg;
+        msg.aruco_id = id;
+        tf::pointTFToMsg(entry.pose.getOrigin(), msg.position);
+        tf::quaternionTFToMsg(entry.pose.getRotation(), msg.orientation);
+        map_msg.poses.push_back(msg);
+    }
+
+    map_pub_.publish(map_msg);
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::checkBlackBoxTriggers(bool tracked, const cv::Mat& tvec) {
+    if (wasTracked_ && !tracked && blackBoxOnLoss_)
+        blackBox_.trigger("tracking_lost");
+
+    if (wasTracked_ && tracked && blackBoxJump_ > 0 && cv::norm(tvec, lastTvec_) > blackBoxJump_)
+        blackBox_.trigger("pose_jump");
+
+    wasTracked_ = tracked;
+    if (tracked) tvec.copyTo(lastTvec_);
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::openPmu() {
+    // The counters count the calling thread, so they are opened by the thread that processes frames
+    if (pmuRequested_) {
+        pmuRequested_ = false;
+        if (!pmu_.open())
+            ROS_WARN("[aruco] PMU counters are not available (%s), continuing without them.", pmu_.error().c_str());
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::publishMarkerCorners(const Detections& markers) {
+
+    aruco_localization::MarkerCornersArray corners_msg;
+    corners_msg.header.frame_id = "camera";
+    corners_msg.header.stamp = ros::Time::now();
+    corners_msg.frame_seq = frameSeq_;
+
+    // The corners are already flat, in the same layout as the message
+    corners_msg.aruco_ids.assign(markers.ids.begin(), markers.ids.end());
+    const float* corners = reinterpret_cast<const float*>(markers.corners.data());
+    corners_msg.corners.assign(corners, corners + 2*markers.corners.size());
+
+    corners_pub_.publish(corners_msg);
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::publishMarkerPatches(const cv::Mat& frame, const Detections& markers) {
+
+    aruco_localization::MarkerPatchArray patch_msg;
+    patch_msg.header.frame_id = "camera";
+    patch_msg.header.stamp = ros::Time::now();
+    patch_msg.patch_size = patchSize_;
+
+    // All patches of this frame are stacked into a single mono8 image
+    cv::Mat patches(patchSize_*markers.size(), patchSize_, CV_8UC1);
+
+    // The corners of a rectified patch, in the same (clockwise from the
+    // top-left) order that ArUco uses for the marker corners
+    const float s = static_cast<float>(patchSize_ - 1);
+    const cv::Point2f dst[4] = { cv::Point2f(0, 0), cv::Point2f(s, 0), cv::Point2f(s, s), cv::Point2f(0, s) };
+
+    cv::Mat warped;
+    for (size_t i=0; i<markers.size(); ++i) {
+        // Homography that maps the detected marker quad onto the patch
+        cv::Mat H = cv::getPerspectiveTransform(markers.cornersOf(i), dst);
+
+        // Warp directly into this marker's slot of the stacked image. Color
+        // frames are converted after warping so only the patch pixels are touched.
+        cv::Mat slot = patches.rowRange(i*patchSize_, (i+1)*patchSize_);
+        if (frame.channels() == 1) {
+            cv::warpPerspective(frame, slot, H, slot.size(), cv::INTER_LINEAR);
+        } else {
+            cv::warpPerspective(frame, warped, H, slot.size(), cv::INTER_LINEAR);
+            cv::cvtColor(warped, slot, cv::COLOR_BGR2GRAY);
+        }
+
+        patch_msg.aruco_ids.push_back(markers.ids[i]);
+    }
+
+    cv_bridge::CvImage(patch_msg.header, sensor_msgs::image_encodings::MONO8, patches).toImageMsg(patch_msg.patches);
+    patch_pub_.publish(patch_msg);
+}
+
+// ----------------------------------------------------------------------------
+
+bool ArucoLocalizer::checkFrameQuality(const FrameJob& job) {
+    stats_.sharpness = job.sharpness;
+    stats_.brightness = job.brightness;
+
+    switch (job.verdict) {
+        case FrameQuality::BLURRED:
+            stats_.frames_skipped_blur++;
+            return false;
+        case FrameQuality::UNDEREXPOSED:
+        case FrameQuality::OVEREXPOSED:
+            stats_.frames_skipped_exposure++;
+            return false;
+        default:
+            return true;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void ArucoLocalizer::updateStats() {
+    stats_.frames_received++;
+    stats_.frames_dropped = framesDropped_.load();
+
+    if (statsPeriod_ <= 0 || stats_.frames_received % statsPeriod_ != 0) return;
+
+    // Performance counters are summed over the frames since the last message
+    stats_.pmu_stages.clear();
+    stats_.pmu_cycles.clear();
+    stats_.pmu_instructions.clear();
+    stats_.pmu_cache_misses.clear();
+    stats_.pmu_branch_misses.clear();
+
+    if (pmu_.isOpen()) {
+        for (size_t i=0; i<pmu_.stages().size(); ++i) {
+            const uint64_t* totals = pmu_.totals(i);
+            stats_.pmu_stages.push_back(pmu_.stages()[i]);
+            stats_.pmu_cycles.push_back(totals[PerfCounters::CYCLES]);
+            stats_.pmu_instructions.push_back(totals[PerfCounters::INSTRUCTIONS]);
+            stats_.pmu_cache_misses.push_back(totals[PerfCounters::CACHE_MISSES]);
+            stats_.pmu_branch_misses.push_back(totals[PerfCounters::BRANCH_MISSES]);
+        }
+        pmu_.reset();
+    }
+
+    Executor::Metrics executor = executor_->metrics();
+    stats_.executor_threads = executor.threads;
+    stats_.executor_queue_depth = executor.queued;
+    stats_.executor_tasks = executor.executed;
+    stats_.executor_steals = executor.steals;
+
+    stats_.header.stamp = ros::Time::now();
+    stats_pub_.publish(stats_);
+}
+
+// ----------------------------------------------------------------------------
+
+cv_bridge::CvImagePtr ArucoLocalizer::convertImage(const sensor_msgs::ImageConstPtr& image) {
+    namespace enc = sensor_msgs::image_encodings;
+
+    // Anything that is not a 16 bit mono image goes through cv_bridge as before
+    if (image->encoding != enc::MONO16 && image->encoding != enc::TYPE_16UC1)
+        return cv_bridge::toCvCopy(image, enc::BGR8);
+
+    // Tone map the (shared, not copied) 16 bit image directly to 8 bit gray.
+    // The ArUco detector works on gray images anyways, so no BGR image is made.
+    cv_bridge::CvImageConstPtr raw = cv_bridge::toCvShare(image);
+
+    cv_bridge::CvImagePtr cv_ptr(new cv_bridge::CvImage(image->header, enc::MONO8));
+    toneMapper_.apply(raw->image, cv_ptr->image);
+    return cv_ptr;
 }
 
 // ----------------------------------------------------------------------------
@@ -278,6 +1242,12 @@ tf::Transform ArucoLocalizer::aruco2tf(const cv::Mat& rvec, const cv::Mat& tvec)
 
 // ----------------------------------------------------------------------------
 
+tf::Transform ArucoLocalizer::aruco2tf(const cv::Vec3f& rvec, const cv::Vec3f& tvec) {
+    return tf::Transform(rodriguesToTFQuat(rvec), tf::Vector3(tvec[0], tvec[1], tvec[2]));
+}
+
+// ----------------------------------------------------------------------------
+
 tf::Quaternion ArucoLocalizer::rodriguesToTFQuat(const cv::Mat& rvec) {
     // convert rvec to double
     cv::Mat rvec64; rvec.convertTo(rvec64, CV_64FC1);
@@ -305,6 +1275,22 @@ tf::Quaternion ArucoLocalizer::rodriguesToTFQuat(const cv::Mat& rvec) {
 
 // ----------------------------------------------------------------------------
 
+tf::Quaternion ArucoLocalizer::rodriguesToTFQuat(const cv::Vec3f& rvec) {
+    // Same as above, with fixed-size matrices (nothing is allocated)
+    cv::Matx33d rot;
+    cv::Rodrigues(cv::Vec3d(rvec[0], rvec[1], rvec[2]), rot);
+
+    tf::Matrix3x3 tf_rot(rot(0,0), rot(0,1), rot(0,2),
+                         rot(1,0), rot(1,1), rot(1,2),
+                         rot(2,0), rot(2,1), rot(2,2));
+
+    tf::Quaternion quat;
+    tf_rot.getRotation(quat);
+    return quat;
+}
+
+// ----------------------------------------------------------------------------
+
 void ArucoLocalizer::saveInputFrame(const cv::Mat& frame) {
     static unsigned int counter = 0;
     saveFrame(frame, "aruco%03i_in.png", counter++);
@@ -0,0 +1,66 @@
+#include "aruco_localization/BandPreprocessor.h"
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+BandPreprocessor::BandPreprocessor() :
+    decimation_(4), bandBytes_(128*1024)
+{}
+
+// ----------------------------------------------------------------------------
+
+void BandPreprocessor::process(const cv::Mat& frame, cv::Mat& gray, cv::Mat* sampled,
+                               Executor& executor, Executor::Clock::time_point deadline)
+{
+    const bool color = frame.channels() == 3;
+    const int d = sampled ? decimation_ : 1;
+
+    // `gray` may still share an earlier gray frame (e.g., a shared memory
+    // slot), which must not be converted into. Only a buffer that `gray`
+    // alone refers to is reused.
+    if (color) {
+        if (gray.data && (!gray.u || gray.u->refcount > 1)) gray.release();
+        gray.create(frame.size(), CV_8UC1);
+    } else {
+        gray = frame;
+    }
+
+    // Nothing to do for a gray frame that is not sampled
+    if (!color && !sampled) return;
+
+    if (sampled) sampled->create(frame.rows / d, frame.cols / d, CV_8UC1);
+    const int rows = frame.rows / d * d;
+
+    // Rows per band, a multiple of the decimation so that no sampled row is split
+    int rowBytes = frame.cols*(frame.channels() + 1);
+    int bandRows = std::max(d, (bandBytes_ / std::max(1, rowBytes)) / d * d);
+    int bands = (rows + bandRows - 1) / bandRows;
+
+    executor.parallelFor(bands, [&](size_t b) {
+        int r0 = b*bandRows;
+        int r1 = std::min<int>(r0 + bandRows, rows);
+
+        if (color) {
+            cv::Mat dst = gray.rowRange(r0, r1);
+            cv::cvtColor(frame.rowRange(r0, r1), dst, cv::COLOR_BGR2GRAY);
+        }
+
+        // Sample the band while it is still in the cache
+        if (!sampled) return;
+        for (int r=r0; r<r1; r+=d) {
+            const uint8_t* src = gray.ptr<uint8_t>(r);
+            uint8_t* dst = sampled->ptr<uint8_t>(r / d);
+            for (int c=0; c<sampled->cols; ++c)
+                dst[c] = src[c*d];
+        }
+    }, deadline);
+
+    // The rows below the last full sampled row still need converting
+    if (color && rows < frame.rows) {
+        cv::Mat dst = gray.rowRange(rows, frame.rows);
+        cv::cvtColor(frame.rowRange(rows, frame.rows), dst, cv::COLOR_BGR2GRAY);
+    }
+}
+
+}
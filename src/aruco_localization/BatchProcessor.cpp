@@ -0,0 +1,206 @@
+#include "aruco_localization/BatchProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::experimental::filesystem;
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+BatchProcessor::BatchProcessor() :
+    backend_("aruco"), threadsPerNode_(0), numa_(true), hugePages_(FramePool::HUGEPAGES_NONE),
+    maxFrameBytes_(4096*3072), seconds_(0), claimed_(0), delivered_(0)
+{}
+
+// ----------------------------------------------------------------------------
+
+void BatchProcessor::setDetector(const std::string& backend, const DetectorBackend::Options& options) {
+    backend_ = backend;
+    options_ = options;
+}
+
+// ----------------------------------------------------------------------------
+
+void BatchProcessor::run(const std::vector<Input>& inputs, const Sink& sink) {
+
+    // Fail here rather than on the workers
+    DetectorBackend::create(backend_, options_);
+
+    std::vector<NumaTopology::Node> topology = NumaTopology::discover();
+    if (!numa_ && topology.size() > 1) {
+        for (size_t i=1; i<topology.size(); ++i)
+            topology[0].cpus.insert(topology[0].cpus.end(), topology[i].cpus.begin(), topology[i].cpus.end());
+        topology.resize(1);
+    }
+
+    // The pools are mapped here, but their pages are only allocated when the
+    // workers (on their node) touch them
+    std::vector<std::unique_ptr<Node>> nodes;
+    for (const NumaTopology::Node& t : topology) {
+        std::unique_ptr<Node> node(new Node);
+        node->topology = t;
+
+        size_t threads = threadsPerNode_ > 0 ? threadsPerNode_ : t.cpus.size();
+        node->pool.create(threads, maxFrameBytes_, hugePages_);
+        node->stats = NodeStats();
+        node->stats.node = t.id;
+        node->stats.threads = threads;
+        nodes.push_back(std::move(node));
+    }
+
+    if (hugePages_ != FramePool::HUGEPAGES_NONE && nodes[0]->pool.hugePages() != hugePages_)
+        std::cerr << "Huge pages are not available as requested, falling back to "
+                  << (nodes[0]->pool.hugePages() == FramePool::HUGEPAGES_NONE ? "regular pages" : "transparent huge pages")
+                  << std::endl;
+
+    claimed_ = 0;
+    delivered_ = 0;
+    pending_.clear();
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (std::unique_ptr<Node>& node : nodes)
+        for (size_t slot=0; slot<node->stats.threads; ++slot)
+            workers.push_back(std::thread(&BatchProcessor::runWorker, this, std::ref(*node), slot,
+                                          std::cref(inputs), std::cref(sink)));
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stats_.clear();
+    for (const std::unique_ptr<Node>& node : nodes)
+        stats_.push_back(node->stats);
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<BatchProcessor::Input> BatchProcessor::listDirectory(const std::string& dir) {
+    std::vector<std::string> files;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".pgm" || ext == ".bmp" || ext == ".tif")
+            files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<Input> inputs(files.size());
+    for (size_t i=0; i<files.size(); ++i) {
+        inputs[i].file = files[i];
+
+        std::string stem = fs::path(files[i]).stem().string();
+        char* end = nullptr;
+        double stamp = std::strtod(stem.c_str(), &end);
+        inputs[i].stamp = (!stem.empty() && *end == '\0') ? stamp : static_cast<double>(i);
+    }
+
+    // Numbered and other file names can be mixed
+    std::stable_sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) {
+        return a.stamp < b.stamp;
+    });
+
+    return inputs;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+void BatchProcessor::runWorker(Node& node, size_t slot, const std::vector<Input>& inputs, const Sink& sink) {
+
+    // Everything this thread allocates from here on (its frame buffer, the
+    // file and detector buffers) is allocated on its node
+    if (numa_) NumaTopology::bindThread(node.topology);
+    node.pool.touch(slot);
+    uint8_t* buffer = node.pool.slot(slot);
+
+    std::unique_ptr<DetectorBackend> detector = DetectorBackend::create(backend_, options_);
+
+    std::vector<uint8_t> bytes;
+    std::vector<aruco::Marker> markers;
+    Detections detections;
+    NodeStats stats = NodeStats();
+
+    // Once the size of the frames is known, this is a header on the frame
+    // buffer and the frames of the same size are decoded straight into it
+    cv::Mat frame;
+
+    for (size_t index = claimed_++; index < inputs.size(); index = claimed_++) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::ifstream file(inputs[index].file, std::ios::binary | std::ios::ate);
+        bytes.resize(file ? static_cast<size_t>(file.tellg()) : 0);
+        file.seekg(0);
+        if (!bytes.empty()) file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+
+        if (bytes.empty() || !file) {
+            frame.release();
+        } else {
+            stats.bytes += bytes.size();
+            cv::imdecode(bytes, cv::IMREAD_GRAYSCALE, &frame);
+        }
+
+        if (frame.empty()) {
+            stats.failed++;
+            detections.assign(std::vector<aruco::Marker>());
+        } else {
+            if (frame.data == buffer) {
+                stats.inPlace++;
+            } else if (frame.total() <= node.pool.slotBytes()) {
+                // A new frame size: moved into the frame buffer, for the next ones
+                cv::Mat pooled(frame.rows, frame.cols, CV_8UC1, buffer);
+                frame.copyTo(pooled);
+                frame = pooled;
+            }
+
+            detector->detect(frame, markers);
+            detections.assign(markers);
+            stats.frames++;
+        }
+
+        stats.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        deliver(index, detections, inputs, sink);
+    }
+
+    std::lock_guard<std::mutex> lock(node.mutex);
+    node.stats.frames += stats.frames;
+    node.stats.failed += stats.failed;
+    node.stats.inPlace += stats.inPlace;
+    node.stats.bytes += stats.bytes;
+    node.stats.busy += stats.busy;
+}
+
+// ----------------------------------------------------------------------------
+
+void BatchProcessor::deliver(size_t index, const Detections& detections, const std::vector<Input>& inputs, const Sink& sink) {
+    std::lock_guard<std::mutex> lock(sinkMutex_);
+
+    if (index != delivered_) {
+        pending_[index] = detections;
+        return;
+    }
+
+    sink(index, inputs[index], detections);
+    delivered_++;
+
+    // Along with the frames that were only waiting for this one
+    for (auto it = pending_.begin(); it != pending_.end() && it->first == delivered_; it = pending_.erase(it)) {
+        sink(it->first, inputs[it->first], it->second);
+        delivered_++;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+}
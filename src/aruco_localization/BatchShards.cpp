@@ -0,0 +1,219 @@
+#include "aruco_localization/BatchShards.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::experimental::filesystem;
+
+namespace aruco_localizer {
+
+// Write `text` to `path` through a temporary file, so that readers (and a
+// restarted process) see either the old or the new contents
+static void replaceFile(const std::string& path, const std::string& text) {
+    std::string tmp = path + ".tmp";
+
+    int fd = ::open(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) throw std::runtime_error("Could not create " + tmp + ": " + strerror(errno));
+
+    bool ok = ::write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()) && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("Could not write " + path + ": " + strerror(errno));
+}
+
+// ----------------------------------------------------------------------------
+
+BatchShards::BatchShards(const std::string& dir, size_t shards) :
+    dir_(dir), shards_(std::max<size_t>(shards, 1))
+{}
+
+// ----------------------------------------------------------------------------
+
+std::vector<BatchProcessor::Input> BatchShards::select(const std::vector<BatchProcessor::Input>& inputs, size_t shard) const {
+    std::vector<BatchProcessor::Input> selected;
+
+    // By file name only, so that the split does not depend on where the
+    // inputs are mounted
+    for (const BatchProcessor::Input& input : inputs)
+        if (hash(fs::path(input.file).filename().string()) % shards_ == shard)
+            selected.push_back(input);
+
+    // In the order of the merged output
+    std::sort(selected.begin(), selected.end(), [](const BatchProcessor::Input& a, const BatchProcessor::Input& b) {
+        if (a.stamp != b.stamp) return a.stamp < b.stamp;
+        return fs::path(a.file).filename().string() < fs::path(b.file).filename().string();
+    });
+
+    return selected;
+}
+
+// ----------------------------------------------------------------------------
+
+std::string BatchShards::outputPath(size_t shard) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "shard-%04zu-of-%04zu.csv", shard, shards_);
+    return (fs::path(dir_) / name).string();
+}
+
+// ----------------------------------------------------------------------------
+
+bool BatchShards::load(size_t shard, Checkpoint& checkpoint) const {
+    std::ifstream file(checkpointPath(shard));
+    if (!file) return false;
+
+    unsigned long long frames, bytes, fingerprint;
+    int finished;
+    if (!(file >> frames >> bytes >> fingerprint >> finished))
+        throw std::runtime_error("Corrupt checkpoint " + checkpointPath(shard));
+
+    checkpoint.frames = frames;
+    checkpoint.bytes = bytes;
+    checkpoint.fingerprint = fingerprint;
+    checkpoint.finished = finished != 0;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+void BatchShards::save(size_t shard, const Checkpoint& checkpoint) const {
+    char text[128];
+    std::snprintf(text, sizeof(text), "%llu %llu %llu %d\n",
+                  (unsigned long long) checkpoint.frames, (unsigned long long) checkpoint.bytes,
+                  (unsigned long long) checkpoint.fingerprint, checkpoint.finished ? 1 : 0);
+    replaceFile(checkpointPath(shard), text);
+}
+
+// ----------------------------------------------------------------------------
+
+void BatchShards::merge(const std::string& output) const {
+
+    // The next line of each shard, ordered by (stamp, file, shard). The lines
+    // of a frame all come from the same shard, and stay in their order.
+    struct Line {
+        double stamp;
+        std::string file;
+        size_t shard;
+        std::string text;
+
+        bool operator>(const Line& other) const {
+            if (stamp != other.stamp) return stamp > other.stamp;
+            if (file != other.file) return file > other.file;
+            return shard > other.shard;
+        }
+    };
+
+    std::vector<std::unique_ptr<std::ifstream>> inputs;
+    for (size_t shard=0; shard<shards_; ++shard) {
+        Checkpoint checkpoint;
+        if (!load(shard, checkpoint) || !checkpoint.finished)
+            throw std::runtime_error("Shard " + std::to_string(shard) + " of " + std::to_string(shards_) + " is not finished");
+
+        inputs.emplace_back(new std::ifstream(outputPath(shard)));
+        if (!*inputs.back()) throw std::runtime_error("Could not open " + outputPath(shard));
+    }
+
+    auto next = [&inputs](size_t shard, Line& line) {
+        while (std::getline(*inputs[shard], line.text)) {
+            size_t comma = line.text.find(',');
+            if (comma == std::string::npos) continue;
+
+            line.stamp = std::strtod(line.text.c_str(), nullptr);
+            line.file.clear();
+            line.shard = shard;
+
+            // The file name, unquoted
+            size_t i = comma + 1;
+            if (i < line.text.size() && line.text[i] == '"') {
+                for (++i; i < line.text.size(); ++i) {
+                    if (line.text[i] == '"' && (i + 1 >= line.text.size() || line.text[i + 1] != '"')) break;
+                    if (line.text[i] == '"') ++i;
+                    line.file += line.text[i];
+                }
+            } else {
+                line.file = line.text.substr(i, line.text.find(',', i) - i);
+            }
+            return true;
+        }
+        return false;
+    };
+
+    std::priority_queue<Line, std::vector<Line>, std::greater<Line>> heads;
+    for (size_t shard=0; shard<shards_; ++shard) {
+        Line line;
+        if (next(shard, line)) heads.push(line);
+    }
+
+    std::string tmp = output + ".tmp";
+    std::ofstream out(tmp);
+    if (!out) throw std::runtime_error("Could not create " + tmp);
+
+    while (!heads.empty()) {
+        Line line = heads.top();
+        heads.pop();
+        out << line.text << '\n';
+
+        if (next(line.shard, line)) heads.push(line);
+    }
+
+    out.close();
+    if (!out || ::rename(tmp.c_str(), output.c_str()) != 0)
+        throw std::runtime_error("Could not write " + output);
+}
+
+// ----------------------------------------------------------------------------
+
+std::string BatchShards::fileField(const std::string& file) {
+    std::string name = fs::path(file).filename().string();
+    if (name.find_first_of(",\"\n") == std::string::npos) return name;
+
+    std::string quoted = "\"";
+    for (char c : name) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t BatchShards::fingerprint(const std::vector<BatchProcessor::Input>& inputs) {
+    uint64_t h = hash("");
+    for (const BatchProcessor::Input& input : inputs)
+        h = hash(fs::path(input.file).filename().string() + '\n', h);
+    return h;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+std::string BatchShards::checkpointPath(size_t shard) const {
+    return outputPath(shard) + ".checkpoint";
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t BatchShards::hash(const std::string& text, uint64_t seed) {
+    uint64_t h = seed;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// ----------------------------------------------------------------------------
+
+}
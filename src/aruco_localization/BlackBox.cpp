@@ -0,0 +1,207 @@
+#include "aruco_localization/BlackBox.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <experimental/filesystem>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+BlackBox::BlackBox() :
+    frames_(0), postFrames_(0), maxMarkers_(0), recorded_(false), active_(&rings_[0]), spare_(&rings_[1]), current_(0),
+    triggered_(false), dumping_(false), postRemaining_(0), stop_(false)
+{
+    for (Ring& ring : rings_)
+        ring.next = ring.size = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+BlackBox::~BlackBox() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+
+    if (writer_.joinable())
+        writer_.join();
+}
+
+// ----------------------------------------------------------------------------
+
+void BlackBox::configure(size_t frames, size_t postFrames, double rate, size_t maxMarkers, const std::string& path) {
+    frames_ = frames > 0 ? frames + postFrames : 0;
+    postFrames_ = postFrames;
+    period_ = ros::Duration(rate > 0 ? 1.0 / rate : 0.0);
+    maxMarkers_ = maxMarkers;
+    path_ = path;
+
+    if (isEnabled() && !writer_.joinable())
+        writer_ = std::thread(&BlackBox::writerLoop, this);
+}
+
+// ----------------------------------------------------------------------------
+
+void BlackBox::record(const cv::Mat& frame, const ros::Time& stamp) {
+    if (!isEnabled()) return;
+
+    bool dumping;
+
+    // Hand the ring over to the writer once the post-trigger frames are in
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lastStamp_ = stamp;
+
+        // Frames that come faster than the rate are left out (with some slack
+        // for jittery stamps), so that the ring spans the configured time.
+        // Stamps that go back (e.g., a bag that loops) start over.
+        recorded_ = lastRecorded_.isZero() || stamp < lastRecorded_ || stamp - lastRecorded_ >= period_ * 0.9;
+        if (!recorded_) return;
+        lastRecorded_ = stamp;
+
+        if (triggered_ && postRemaining_-- == 0) {
+            std::swap(active_, spare_);
+            active_->next = active_->size = 0;
+            triggered_ = false;
+            dumping_ = true;
+            cond_.notify_all();
+        }
+        dumping = dumping_;
+    }
+
+    // Both rings are allocated for the first frame, and again if the frame size changes
+    if (!fits(*active_, frame)) {
+        allocate(*active_, frame);
+        if (!dumping) allocate(*spare_, frame);
+    }
+
+    current_ = active_->next;
+    frame.copyTo(active_->images[current_]);
+    active_->stamps[current_] = stamp;
+    active_->counts[current_] = 0;
+
+    active_->next = (current_ + 1) % frames_;
+    active_->size = std::min(active_->size + 1, frames_);
+}
+
+// ----------------------------------------------------------------------------
+
+void BlackBox::setDetections(const Detections& markers) {
+    if (!isEnabled() || !recorded_ || active_->size == 0) return;
+
+    size_t n = std::min(markers.size(), maxMarkers_);
+    Detection* detections = &active_->detections[current_ * maxMarkers_];
+
+    for (size_t i=0; i<n; ++i) {
+        detections[i].id = markers.ids[i];
+        std::copy(markers.cornersOf(i), markers.cornersOf(i) + 4, detections[i].corners);
+    }
+
+    active_->counts[current_] = n;
+}
+
+// ----------------------------------------------------------------------------
+
+bool BlackBox::trigger(const std::string& reason) {
+    if (!isEnabled()) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (triggered_ || dumping_) return false;
+
+    triggered_ = true;
+    postRemaining_ = postFrames_;
+    reason_ = reason;
+    triggerStamp_ = lastStamp_;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+bool BlackBox::fits(const Ring& ring, const cv::Mat& frame) const {
+    return !ring.images.empty() && ring.images[0].size() == frame.size() && ring.images[0].type() == frame.type();
+}
+
+// ----------------------------------------------------------------------------
+
+void BlackBox::allocate(Ring& ring, const cv::Mat& frame) {
+    ring.images.resize(frames_);
+    for (cv::Mat& image : ring.images)
+        image.create(frame.size(), frame.type());
+
+    ring.stamps.resize(frames_);
+    ring.detections.resize(frames_ * maxMarkers_);
+    ring.counts.assign(frames_, 0);
+    ring.next = ring.size = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void BlackBox::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cond_.wait(lock, [this] { return stop_ || dumping_; });
+        if (stop_) return;
+
+        // The spare ring is not touched by `record` while it is being dumped
+        std::string reason = reason_;
+        ros::Time stamp = triggerStamp_;
+        lock.unlock();
+        dump(*spare_, stamp, reason);
+        lock.lock();
+
+        dumping_ = false;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void BlackBox::dump(const Ring& ring, const ros::Time& stamp, const std::string& reason) {
+    if (ring.size == 0) return;
+
+    // Frames are written oldest first
+    size_t first = (ring.next + frames_ - ring.size) % frames_;
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "/blackbox_%u.%09u_", stamp.sec, stamp.nsec);
+    std::string dir = path_ + name + reason;
+
+    try {
+        std::experimental::filesystem::create_directories(dir);
+    } catch (std::exception& e) {
+        ROS_WARN("[aruco] Could not dump the black box: %s", e.what());
+        return;
+    }
+
+    FILE* csv = std::fopen((dir + "/detections.csv").c_str(), "w");
+    if (!csv) {
+        ROS_WARN("[aruco] Could not dump the black box to %s", dir.c_str());
+        return;
+    }
+    std::fprintf(csv, "frame,stamp,id,x0,y0,x1,y1,x2,y2,x3,y3\n");
+
+    for (size_t i=0; i<ring.size; ++i) {
+        size_t idx = (first + i) % frames_;
+
+        char file[32];
+        std::snprintf(file, sizeof(file), "/%05zu.png", i);
+        cv::imwrite(dir + file, ring.images[idx]);
+
+        for (size_t j=0; j<ring.counts[idx]; ++j) {
+            const Detection& d = ring.detections[idx * maxMarkers_ + j];
+            std::fprintf(csv, "%zu,%u.%09u,%d", i, ring.stamps[idx].sec, ring.stamps[idx].nsec, d.id);
+            for (int k=0; k<4; ++k)
+                std::fprintf(csv, ",%.2f,%.2f", d.corners[k].x, d.corners[k].y);
+            std::fprintf(csv, "\n");
+        }
+    }
+
+    std::fclose(csv);
+    ROS_INFO("[aruco] Black box (%zu frames) written to %s", ring.size, dir.c_str());
+}
+
+}
@@ -0,0 +1,37 @@
+#include "aruco_localization/DeadBand.h"
+
+#include <math.h>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+DeadBand::DeadBand() :
+    translation_(0.01), rotation_(1.0*M_PI/180.0), maxInterval_(1.0)
+{}
+
+// ----------------------------------------------------------------------------
+
+bool DeadBand::update(const std::vector<Pose>& poses, const ros::Time& now, bool force) {
+
+    bool publish = force || lastTime_.isZero() || now - lastTime_ > maxInterval_;
+
+    for (size_t i=0; i<poses.size() && !publish; ++i) {
+        std::map<int, Pose>::const_iterator last = last_.find(poses[i].key);
+
+        publish = last == last_.end()
+               || poses[i].position.distance(last->second.position) > translation_
+               || poses[i].orientation.angleShortestPath(last->second.orientation) > rotation_;
+    }
+
+    if (!publish) return false;
+
+    last_.clear();
+    for (const Pose& pose : poses)
+        last_[pose.key] = pose;
+    lastTime_ = now;
+
+    return true;
+}
+
+}
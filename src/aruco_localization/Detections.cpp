@@ -0,0 +1,25 @@
+#include "aruco_localization/Detections.h"
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+void Detections::assign(const std::vector<aruco::Marker>& markers) {
+    const size_t n = markers.size();
+
+    ids.resize(n);
+    corners.resize(4*n);
+    for (size_t i=0; i<n; ++i) {
+        ids[i] = markers[i].id;
+        for (size_t k=0; k<4; ++k)
+            corners[4*i + k] = k < markers[i].size() ? markers[i][k] : cv::Point2f(0, 0);
+    }
+
+    rvecs.resize(n);
+    tvecs.resize(n);
+    errors.assign(n, 0.0f);
+    solved.assign(n, 0);
+    flipped.assign(n, 0);
+}
+
+}
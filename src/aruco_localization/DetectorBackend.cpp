@@ -0,0 +1,244 @@
+#include "aruco_localization/DetectorBackend.h"
+#include "aruco_localization/GridDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef HAVE_OPENCV_ARUCO
+#include <opencv2/aruco.hpp>
+#endif
+
+#ifdef HAVE_APRILTAG
+#include <apriltag/apriltag.h>
+#include <apriltag/tag16h5.h>
+#include <apriltag/tag25h9.h>
+#include <apriltag/tag36h11.h>
+#endif
+
+namespace aruco_localizer {
+
+namespace {
+
+    // Like ArUco, allow correcting up to a fraction of what the dictionary's
+    // minimum Hamming distance (tau) guarantees to be unambiguous
+    int maxCorrection(const aruco::Dictionary& dict, double rate) {
+        return static_cast<int>(rate*(static_cast<int>(dict.tau()) - 1)/2);
+    }
+
+    // ------------------------------------------------------------------------
+
+    class ArucoBackend : public DetectorBackend
+    {
+    public:
+        explicit ArucoBackend(const Options& options) : name_("aruco") {
+            detector_.setDictionary(options.dictionary);
+            detector_.setCornerRefinementMethod(aruco::MarkerDetector::LINES);
+
+            // Replace the generic labeler by a decoder compiled for the dictionary's
+            // grid size (if it is a predefined one)
+            if (options.specializedDecoder) {
+                cv::Ptr<aruco::MarkerLabeler> decoder = createGridDecoder(options.dictionary, options.errorCorrectionRate);
+                if (!decoder.empty()) {
+                    detector_.setMarkerLabeler(decoder);
+                    name_ += " (specialized decoder)";
+                }
+            }
+        }
+
+        void detect(const cv::Mat& frame, std::vector<aruco::Marker>& markers) override {
+            // ArUco makes new markers every time, which are copied into the reused ones
+            detector_.detect(frame, found_);
+
+            markers.resize(found_.size());
+            for (size_t i=0; i<found_.size(); ++i) {
+                markers[i].id = found_[i].id;
+                markers[i].assign(found_[i].begin(), found_[i].end());
+            }
+        }
+
+        std::string getName() const override { return name_; }
+
+    private:
+        aruco::MarkerDetector detector_;
+        std::string name_;
+
+        // reused from frame to frame
+        std::vector<aruco::Marker> found_;
+    };
+
+    // ------------------------------------------------------------------------
+
+#ifdef HAVE_OPENCV_ARUCO
+    class OpenCvBackend : public DetectorBackend
+    {
+    public:
+        explicit OpenCvBackend(const Options& options) {
+            aruco::Dictionary dict;
+            try {
+                dict = aruco::Dictionary::loadPredefined(options.dictionary);
+            } catch (cv::Exception& e) {
+                throw std::runtime_error("The opencv backend only supports predefined dictionaries, not " + options.dictionary);
+            }
+            const int n = static_cast<int>(std::round(std::sqrt(dict.nbits())));
+
+            // The ArUco dictionary, converted to cv::aruco's byte lists. ArUco's
+            // codes are row-major from the top-left cell, MSB first (the
+            // bottom-right cell is bit 0); white is 1 in both.
+            cv::Mat bytes;
+            for (const auto& entry : dict.getMapCode()) {
+                cv::Mat bits(n, n, CV_8UC1);
+                for (int i=0; i<n*n; ++i)
+                    bits.at<uint8_t>(i / n, i % n) = (entry.first >> (n*n - 1 - i)) & 1;
+
+                bytes.push_back(cv::aruco::Dictionary::getByteListFromBits(bits));
+                ids_.push_back(entry.second);
+            }
+
+            dictionary_ = cv::makePtr<cv::aruco::Dictionary>(bytes, n, maxCorrection(dict, 1.0));
+            params_ = cv::makePtr<cv::aruco::DetectorParameters>();
+            params_->errorCorrectionRate = options.errorCorrectionRate;
+            params_->cornerRefinementMethod = cv::aruco::CORNER_REFINE_SUBPIX;
+        }
+
+        void detect(const cv::Mat& frame, std::vector<aruco::Marker>& markers) override {
+            cv::aruco::detectMarkers(frame, dictionary_, corners_, indices_, params_);
+
+            markers.resize(indices_.size());
+            for (size_t i=0; i<indices_.size(); ++i) {
+                markers[i].id = ids_[indices_[i]];
+                markers[i].assign(corners_[i].begin(), corners_[i].end());
+            }
+        }
+
+        std::string getName() const override { return "opencv"; }
+
+    private:
+        cv::Ptr<cv::aruco::Dictionary> dictionary_;
+        cv::Ptr<cv::aruco::DetectorParameters> params_;
+
+        // ArUco ID of every entry of `dictionary_`
+        std::vector<int> ids_;
+
+        // reused from frame to frame
+        std::vector<std::vector<cv::Point2f>> corners_;
+        std::vector<int> indices_;
+    };
+#endif
+
+    // ------------------------------------------------------------------------
+
+#ifdef HAVE_APRILTAG
+    class AprilTagBackend : public DetectorBackend
+    {
+    public:
+        explicit AprilTagBackend(const Options& options) : family_(nullptr), destroy_(nullptr) {
+            // AprilTag families that ArUco has the same dictionary (and IDs) of
+            struct Family { const char* dictionary; apriltag_family_t* (*create)(); void (*destroy)(apriltag_family_t*); };
+            const Family families[] = {
+                { "TAG16h5", tag16h5_create, tag16h5_destroy },
+                { "TAG25h9", tag25h9_create, tag25h9_destroy },
+                { "TAG36h11", tag36h11_create, tag36h11_destroy },
+            };
+
+            for (const Family& family : families) {
+                if (options.dictionary == family.dictionary) {
+                    family_ = family.create();
+                    destroy_ = family.destroy;
+                }
+            }
+
+            if (!family_)
+                throw std::runtime_error("AprilTag has no family for dictionary " + options.dictionary);
+
+            // Bit correction takes a lot of memory beyond a few bits
+            aruco::Dictionary dict = aruco::Dictionary::loadPredefined(options.dictionary);
+            detector_ = apriltag_detector_create();
+            apriltag_detector_add_family_bits(detector_, family_, std::min(3, maxCorrection(dict, options.errorCorrectionRate)));
+
+            // Frames and markers are already spread over the cores by the node
+            detector_->nthreads = 1;
+        }
+
+        ~AprilTagBackend() {
+            apriltag_detector_destroy(detector_);
+            destroy_(family_);
+        }
+
+        void detect(const cv::Mat& frame, std::vector<aruco::Marker>& markers) override {
+            if (frame.channels() == 3) cv::cvtColor(frame, gray_, cv::COLOR_BGR2GRAY);
+            else gray_ = frame;
+
+            image_u8_t image;
+            image.width = gray_.cols;
+            image.height = gray_.rows;
+            image.stride = static_cast<int32_t>(gray_.step);
+            image.buf = gray_.data;
+
+            zarray_t* detections = apriltag_detector_detect(detector_, &image);
+
+            markers.resize(zarray_size(detections));
+            for (size_t i=0; i<markers.size(); ++i) {
+                apriltag_detection_t* detection;
+                zarray_get(detections, i, &detection);
+
+                // AprilTag's corners go counter-clockwise from the bottom-left
+                markers[i].id = detection->id;
+                markers[i].resize(4);
+                for (int k=0; k<4; ++k)
+                    markers[i][k] = cv::Point2f(detection->p[3 - k][0], detection->p[3 - k][1]);
+            }
+
+            apriltag_detections_destroy(detections);
+        }
+
+        std::string getName() const override { return "apriltag"; }
+
+    private:
+        apriltag_family_t* family_;
+        void (*destroy_)(apriltag_family_t*);
+        apriltag_detector_t* detector_;
+
+        // reused from frame to frame
+        cv::Mat gray_;
+
+        AprilTagBackend(const AprilTagBackend&);
+        AprilTagBackend& operator=(const AprilTagBackend&);
+    };
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+std::unique_ptr<DetectorBackend> DetectorBackend::create(const std::string& backend, const Options& options) {
+    if (backend == "aruco")
+        return std::unique_ptr<DetectorBackend>(new ArucoBackend(options));
+
+#ifdef HAVE_OPENCV_ARUCO
+    if (backend == "opencv")
+        return std::unique_ptr<DetectorBackend>(new OpenCvBackend(options));
+#endif
+
+#ifdef HAVE_APRILTAG
+    if (backend == "apriltag")
+        return std::unique_ptr<DetectorBackend>(new AprilTagBackend(options));
+#endif
+
+    throw std::runtime_error("Detector backend '" + backend + "' is not built in");
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<std::string> DetectorBackend::available() {
+    std::vector<std::string> names = { "aruco" };
+#ifdef HAVE_OPENCV_ARUCO
+    names.push_back("opencv");
+#endif
+#ifdef HAVE_APRILTAG
+    names.push_back("apriltag");
+#endif
+    return names;
+}
+
+}
@@ -0,0 +1,228 @@
+#include "aruco_localization/Executor.h"
+
+#include <algorithm>
+
+namespace aruco_localizer {
+
+// Index of the worker that the current thread is, or -1 for other threads
+static thread_local int currentWorker = -1;
+
+// ----------------------------------------------------------------------------
+
+Executor& Executor::instance(unsigned int threads) {
+    static Executor executor(threads ? threads : std::max(1u, std::thread::hardware_concurrency()));
+    return executor;
+}
+
+// ----------------------------------------------------------------------------
+
+Executor::Executor(unsigned int threads) :
+    stop_(false), queued_(0), executed_(0), steals_(0), seq_(0)
+{
+    for (unsigned int i=0; i<threads; ++i)
+        workers_.emplace_back(new Worker);
+
+    for (unsigned int i=0; i<threads; ++i)
+        threads_.emplace_back(&Executor::run, this, i);
+}
+
+// ----------------------------------------------------------------------------
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for (std::thread& thread : threads_)
+        thread.join();
+}
+
+// ----------------------------------------------------------------------------
+
+void Executor::submit(std::function<void()> task, Clock::time_point deadline) {
+    // Workers queue onto themselves (their data is hot in their cache),
+    // everyone else spreads the tasks over the workers
+    unsigned int target = (currentWorker >= 0) ? currentWorker : seq_ % workers_.size();
+
+    {
+        Worker& worker = *workers_[target];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push(Task{ std::move(task), deadline, seq_++ });
+        queued_++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wake_.notify_one();
+}
+
+// ----------------------------------------------------------------------------
+
+void Executor::parallelFor(size_t n, const std::function<void(size_t)>& fn, Clock::time_point deadline) {
+    if (n == 0) return;
+
+    // Indices are handed out one at a time from a shared counter, so whoever
+    // is free (including this thread) takes the next one. The state is shared
+    // because helpers may only start after this call has returned.
+    struct State {
+        std::function<void(size_t)> fn;
+        size_t n;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->fn = fn;
+    state->n = n;
+    state->next = 0;
+    state->done = 0;
+
+    auto work = [state]() {
+        size_t i;
+        while ((i = state->next++) < state->n) {
+            state->fn(i);
+
+            if (++state->done == state->n) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min(n - 1, workers_.size());
+    for (size_t i=0; i<helpers; ++i)
+        submit(work, deadline);
+
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state]() { return state->done == state->n; });
+}
+
+// ----------------------------------------------------------------------------
+
+void Executor::parallelForOrdered(size_t n, const std::function<void(size_t)>& fn,
+                                  const std::function<void(size_t)>& then, Clock::time_point deadline) {
+    if (n == 0) return;
+
+    // As in parallelFor, plus a flag per index that is set once fn(i) has run
+    struct State {
+        std::function<void(size_t)> fn;
+        size_t n;
+        std::atomic<size_t> next;
+        std::unique_ptr<std::atomic<bool>[]> ready;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->fn = fn;
+    state->n = n;
+    state->next = 0;
+    state->ready.reset(new std::atomic<bool>[n]);
+    for (size_t i=0; i<n; ++i) state->ready[i] = false;
+
+    // Run one index, returns false once they have all been handed out
+    auto step = [](State& s) {
+        size_t i = s.next++;
+        if (i >= s.n) return false;
+
+        s.fn(i);
+        s.ready[i] = true;
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.finished.notify_all();
+        return true;
+    };
+
+    auto work = [state, step]() {
+        while (step(*state));
+    };
+
+    size_t helpers = std::min(n - 1, workers_.size());
+    for (size_t i=0; i<helpers; ++i)
+        submit(work, deadline);
+
+    // This thread helps out until the next index in order is ready, and only
+    // waits once there is nothing left to hand out
+    for (size_t i=0; i<n; ++i) {
+        while (!state->ready[i] && step(*state));
+
+        if (!state->ready[i]) {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->finished.wait(lock, [&state, i]() { return state->ready[i].load(); });
+        }
+
+        then(i);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+Executor::Metrics Executor::metrics() const {
+    Metrics m;
+    m.threads = workers_.size();
+    m.queued = queued_;
+    m.executed = executed_;
+    m.steals = steals_;
+    return m;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+void Executor::run(unsigned int self) {
+    currentWorker = self;
+
+    Task task;
+    while (true) {
+        if (pop(self, task)) {
+            task.fn();
+            task.fn = nullptr;
+            executed_++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (stop_) return;
+
+        // The timeout covers a task that was queued between `pop` and here
+        wake_.wait_for(lock, std::chrono::milliseconds(10), [this]() { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) return;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool Executor::pop(unsigned int self, Task& task) {
+    if (queued_ == 0) return false;
+
+    for (size_t k=0; k<workers_.size(); ++k) {
+        unsigned int victim = (self + k) % workers_.size();
+        Worker& worker = *workers_[victim];
+
+        // Never wait on another worker's queue, just move on to the next one
+        std::unique_lock<std::mutex> lock(worker.mutex, std::defer_lock);
+        if (victim == self) lock.lock();
+        else if (!lock.try_lock()) continue;
+
+        if (worker.queue.empty()) continue;
+
+        task = worker.queue.top();
+        worker.queue.pop();
+        queued_--;
+
+        if (victim != self) steals_++;
+        return true;
+    }
+
+    return false;
+}
+
+}
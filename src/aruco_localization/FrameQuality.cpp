@@ -0,0 +1,49 @@
+#include "aruco_localization/FrameQuality.h"
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+FrameQuality::FrameQuality() :
+    decimation_(4), minSharpness_(0), minBrightness_(0), maxBrightness_(255),
+    sharpness_(0), brightness_(0)
+{}
+
+// ----------------------------------------------------------------------------
+
+FrameQuality::Verdict FrameQuality::assess(const cv::Mat& frame) {
+
+    // Sparsely sample the frame. Nearest neighbor sampling (as opposed to
+    // area averaging) keeps the high frequency content that blur removes.
+    cv::Size size(frame.cols / decimation_, frame.rows / decimation_);
+    cv::resize(frame, sampled_, size, 0, 0, cv::INTER_NEAREST);
+
+    if (sampled_.channels() == 3)
+        cv::cvtColor(sampled_, gray_, cv::COLOR_BGR2GRAY);
+    else
+        gray_ = sampled_;
+
+    return assessSampled(gray_);
+}
+
+// ----------------------------------------------------------------------------
+
+FrameQuality::Verdict FrameQuality::assessSampled(const cv::Mat& sampled) {
+
+    // The variance of the Laplacian is a measure of edge energy
+    cv::Laplacian(sampled, laplacian_, CV_16S);
+
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(laplacian_, mean, stddev);
+    sharpness_ = stddev[0]*stddev[0];
+    brightness_ = cv::mean(sampled)[0];
+
+    // Exposure is checked first, since a black or washed out frame has no edges either
+    if (brightness_ < minBrightness_) return UNDEREXPOSED;
+    if (brightness_ > maxBrightness_) return OVEREXPOSED;
+    if (sharpness_ < minSharpness_) return BLURRED;
+
+    return GOOD;
+}
+
+}
@@ -0,0 +1,257 @@
+#include "aruco_localization/FrameRing.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace aruco_localizer {
+
+static const uint32_t MAGIC = 0x41524652;   // "ARFR"
+static const uint32_t VERSION = 3;
+
+// Everything is padded to cache lines so that slots don't share them
+static const size_t ALIGN = 64;
+static size_t aligned(size_t bytes) { return (bytes + ALIGN - 1) / ALIGN * ALIGN; }
+
+struct FrameRing::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint64_t slotBytes;
+
+    // tells a ring from the one it replaced (its creation time, in ns)
+    uint64_t generation;
+
+    // sequence number of the newest published frame (0: none yet)
+    std::atomic<uint64_t> head;
+
+    // sequence numbers skipped because their slot was being read
+    std::atomic<uint64_t> skipped;
+};
+
+struct FrameRing::Slot {
+    // sequence number of the frame in this slot, 0 while it is being written
+    std::atomic<uint64_t> seq;
+
+    // number of consumers that are reading this slot
+    std::atomic<uint32_t> refs;
+
+    // the header's `skipped` once this frame was published
+    uint64_t skipped;
+
+    uint64_t stamp;
+    uint32_t width;
+    uint32_t height;
+    uint32_t step;
+    int32_t type;
+};
+
+// ----------------------------------------------------------------------------
+
+FrameRing::FrameRing() :
+    header_(nullptr), size_(0), owner_(false), generation_(0)
+{}
+
+// ----------------------------------------------------------------------------
+
+FrameRing::~FrameRing() {
+    if (header_) munmap(header_, size_);
+    if (owner_) shm_unlink(name_.c_str());
+}
+
+// ----------------------------------------------------------------------------
+
+void FrameRing::create(const std::string& name, uint32_t slots, uint64_t slotBytes) {
+    // Start from scratch, consumers of an old ring will notice the new one when they re-attach
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) throw std::runtime_error("Could not create shared memory " + name + ": " + strerror(errno));
+
+    slotBytes = aligned(slotBytes);
+    size_t size = aligned(sizeof(Header)) + slots*(aligned(sizeof(Slot)) + slotBytes);
+    if (ftruncate(fd, size) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not size shared memory " + name + ": " + strerror(errno));
+    }
+
+    map(fd, size);
+    name_ = name;
+    owner_ = true;
+
+    // The fresh mapping is zeroed, i.e., all sequence numbers and references are 0
+    header_->slots = slots;
+    header_->slotBytes = slotBytes;
+    header_->generation = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    header_->version = VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = MAGIC;
+}
+
+// ----------------------------------------------------------------------------
+
+void FrameRing::attach(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) throw std::runtime_error("Could not open shared memory " + name + ": " + strerror(errno));
+
+    struct stat st;
+    fstat(fd, &st);
+    map(fd, st.st_size);
+    name_ = name;
+
+    if (size_ < sizeof(Header) || header_->magic != MAGIC || header_->version != VERSION) {
+        munmap(header_, size_);
+        header_ = nullptr;
+        throw std::runtime_error("Shared memory " + name + " is not a frame ring (yet)");
+    }
+
+    generation_ = header_->generation;
+}
+
+// ----------------------------------------------------------------------------
+
+void FrameRing::detach() {
+    if (header_) munmap(header_, size_);
+    header_ = nullptr;
+    size_ = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+bool FrameRing::replaced() const {
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0) return true;
+
+    // Only the header of whatever is there now
+    struct stat st;
+    void* mem = (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+              ? mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (mem == MAP_FAILED) return true;
+
+    const Header* current = static_cast<const Header*>(mem);
+    bool same = current->magic == MAGIC && current->version == VERSION && current->generation == generation_;
+    munmap(mem, sizeof(Header));
+    return !same;
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t FrameRing::slotBytes() const {
+    return header_ ? header_->slotBytes : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+bool FrameRing::publish(const uint8_t* data, uint32_t width, uint32_t height, uint32_t step,
+                        int32_t type, uint32_t bytesPerPixel, uint64_t stamp)
+{
+    const uint32_t rowBytes = width*bytesPerPixel;
+    if (static_cast<uint64_t>(rowBytes)*height > header_->slotBytes) return false;
+
+    // The first slot from the head on that nobody is reading, skipping the
+    // sequence numbers of the others
+    const uint64_t head = header_->head.load();
+    uint64_t seq = head + 1;
+    Slot* s = nullptr;
+    for (; seq <= head + header_->slots; ++seq) {
+        s = slot(seq % header_->slots);
+
+        // Invalidate the slot, then check that nobody is reading it. A consumer
+        // does the opposite (reference, then check the sequence number), so one
+        // of the two always sees the other (both are sequentially consistent).
+        uint64_t old = s->seq.exchange(0);
+        if (s->refs.load() == 0) break;
+        s->seq.store(old);
+    }
+
+    if (seq > head + header_->slots) return false;
+    const uint64_t skipped = header_->skipped.fetch_add(seq - head - 1) + (seq - head - 1);
+
+    uint8_t* pixels = reinterpret_cast<uint8_t*>(s) + aligned(sizeof(Slot));
+    for (uint32_t r=0; r<height; ++r)
+        memcpy(pixels + r*rowBytes, data + r*step, rowBytes);
+
+    s->skipped = skipped;
+    s->stamp = stamp;
+    s->width = width;
+    s->height = height;
+    s->step = rowBytes;
+    s->type = type;
+
+    s->seq.store(seq);
+    header_->head.store(seq);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+bool FrameRing::acquire(uint64_t after, Frame& frame) {
+    while (true) {
+        uint64_t seq = header_->head.load();
+        if (seq <= after) return false;
+
+        uint32_t index = seq % header_->slots;
+        Slot* s = slot(index);
+
+        s->refs.fetch_add(1);
+        if (s->seq.load() != seq) {
+            // Overwritten (or being overwritten) in the meantime, try the newest one again
+            s->refs.fetch_sub(1);
+            continue;
+        }
+
+        frame.seq = seq;
+        frame.skipped = s->skipped;
+        frame.stamp = s->stamp;
+        frame.width = s->width;
+        frame.height = s->height;
+        frame.step = s->step;
+        frame.type = s->type;
+        frame.data = reinterpret_cast<const uint8_t*>(s) + aligned(sizeof(Slot));
+        frame.slot = index;
+        return true;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void FrameRing::release(const Frame& frame) {
+    slot(frame.slot)->refs.fetch_sub(1);
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t FrameRing::skipped() const {
+    return header_ ? header_->skipped.load() : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+FrameRing::Slot* FrameRing::slot(uint32_t index) const {
+    uint8_t* base = reinterpret_cast<uint8_t*>(header_) + aligned(sizeof(Header));
+    return reinterpret_cast<Slot*>(base + index*(aligned(sizeof(Slot)) + header_->slotBytes));
+}
+
+// ----------------------------------------------------------------------------
+
+void FrameRing::map(int fd, size_t size) {
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mem == MAP_FAILED) throw std::runtime_error(std::string("Could not map shared memory: ") + strerror(errno));
+
+    header_ = static_cast<Header*>(mem);
+    size_ = size;
+}
+
+}
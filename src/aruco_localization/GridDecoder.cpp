@@ -0,0 +1,31 @@
+#include "aruco_localization/GridDecoder.h"
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+cv::Ptr<aruco::MarkerLabeler> createGridDecoder(const std::string& dictionary, double errorCorrectionRate) {
+    // Custom (file based) dictionaries keep ArUco's generic labeler
+    aruco::Dictionary dict;
+    try {
+        dict = aruco::Dictionary::loadPredefined(dictionary);
+    } catch (cv::Exception& e) {
+        return cv::Ptr<aruco::MarkerLabeler>();
+    }
+
+    // Like ArUco, allow correcting up to a fraction of what the dictionary's
+    // minimum Hamming distance (tau) guarantees to be unambiguous
+    int maxCorrection = static_cast<int>(errorCorrectionRate*(static_cast<int>(dict.tau()) - 1)/2);
+
+    switch (static_cast<int>(std::round(std::sqrt(dict.nbits())))) {
+        case 3: return cv::Ptr<aruco::MarkerLabeler>(new GridDecoder<3>(dict, maxCorrection));
+        case 4: return cv::Ptr<aruco::MarkerLabeler>(new GridDecoder<4>(dict, maxCorrection));
+        case 5: return cv::Ptr<aruco::MarkerLabeler>(new GridDecoder<5>(dict, maxCorrection));
+        case 6: return cv::Ptr<aruco::MarkerLabeler>(new GridDecoder<6>(dict, maxCorrection));
+        case 7: return cv::Ptr<aruco::MarkerLabeler>(new GridDecoder<7>(dict, maxCorrection));
+        case 8: return cv::Ptr<aruco::MarkerLabeler>(new GridDecoder<8>(dict, maxCorrection));
+        default: return cv::Ptr<aruco::MarkerLabeler>();
+    }
+}
+
+}
@@ -0,0 +1,86 @@
+#include "aruco_localization/LiveMarkerMap.h"
+
+#include <sstream>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+LiveMarkerMap::LiveMarkerMap() {
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->version = 0;
+    std::atomic_store(&state_, std::shared_ptr<const State>(state));
+}
+
+// ----------------------------------------------------------------------------
+
+void LiveMarkerMap::reset(const aruco::MarkerMap& map) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->map = map;
+    for (size_t i=0; i<map.size(); ++i)
+        state->index[map[i].id] = i;
+    state->version = get()->version + 1;
+
+    std::atomic_store(&state_, std::shared_ptr<const State>(state));
+}
+
+// ----------------------------------------------------------------------------
+
+bool LiveMarkerMap::apply(Operation op, const std::vector<int>& ids, const std::vector<cv::Point3f>& corners, std::string& error) {
+    if (op != REMOVE && corners.size() != 4*ids.size()) {
+        error = "Every marker needs 4 corners.";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    // Only the changed entries of the copy (and of its index) are touched
+    std::shared_ptr<State> next = std::make_shared<State>(*get());
+
+    for (size_t i=0; i<ids.size(); ++i) {
+        std::unordered_map<int, size_t>::iterator it = next->index.find(ids[i]);
+        bool known = it != next->index.end();
+
+        if (op == INSERT && known) {
+            std::ostringstream ss; ss << "Marker " << ids[i] << " is already in the map.";
+            error = ss.str();
+            return false;
+        }
+        if (op != INSERT && !known) {
+            std::ostringstream ss; ss << "Marker " << ids[i] << " is not in the map.";
+            error = ss.str();
+            return false;
+        }
+
+        if (op == REMOVE) {
+            // The last entry fills the hole, so only its index entry changes
+            size_t hole = it->second;
+            next->index.erase(it);
+            if (hole != next->map.size() - 1) {
+                next->map[hole] = next->map.back();
+                next->index[next->map[hole].id] = hole;
+            }
+            next->map.pop_back();
+            continue;
+        }
+
+        aruco::Marker3DInfo info(ids[i]);
+        info.assign(corners.begin() + 4*i, corners.begin() + 4*i + 4);
+
+        if (op == INSERT) {
+            next->index[ids[i]] = next->map.size();
+            next->map.push_back(info);
+        } else {
+            next->map[it->second] = info;
+        }
+    }
+
+    next->version++;
+    std::atomic_store(&state_, std::shared_ptr<const State>(next));
+
+    return true;
+}
+
+}
@@ -0,0 +1,117 @@
+#include "aruco_localization/MarkerMapper.h"
+
+#include <algorithm>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+MarkerMapper::MarkerMapper() :
+    markerSize_(0.0298), maxWeight_(100), origin_(-1)
+{}
+
+// ----------------------------------------------------------------------------
+
+size_t MarkerMapper::update(const std::vector<Observation>& observations) {
+    if (observations.empty()) return 0;
+
+    // The first marker ever seen is the origin, and stays put
+    if (markers_.empty()) {
+        origin_ = observations[0].id;
+        markers_[origin_] = { tf::Transform::getIdentity(), maxWeight_ };
+        changed_.insert(origin_);
+    }
+
+    // Locate the camera from the known markers, weighted by how well they are known
+    tf::Vector3 position(0, 0, 0);
+    tf::Quaternion orientation(0, 0, 0, 0);
+    double total = 0;
+
+    for (const Observation& obs : observations) {
+        std::map<int, Entry>::const_iterator it = markers_.find(obs.id);
+        if (it == markers_.end()) continue;
+
+        tf::Transform camera = it->second.pose * obs.pose.inverse();
+        tf::Quaternion q = camera.getRotation();
+
+        // q and -q are the same rotation, so they are summed in the same hemisphere
+        if (total > 0 && orientation.dot(q) < 0) q = -q;
+
+        position += camera.getOrigin() * it->second.weight;
+        orientation += q * it->second.weight;
+        total += it->second.weight;
+    }
+
+    // Markers can only be placed if they are seen together with known ones
+    if (total == 0) return 0;
+
+    tf::Transform camera(orientation.normalized(), position / total);
+
+    size_t added = 0;
+    for (const Observation& obs : observations) {
+        tf::Transform pose = camera * obs.pose;
+
+        std::map<int, Entry>::iterator it = markers_.find(obs.id);
+        if (it == markers_.end()) {
+            markers_[obs.id] = { pose, 1 };
+            changed_.insert(obs.id);
+            ++added;
+            continue;
+        }
+
+        if (obs.id == origin_) continue;
+
+        // Recursive average of the observations, which turns into a moving
+        // average once the weight is at its maximum
+        Entry& entry = it->second;
+        double alpha = 1.0 / (entry.weight + 1);
+        entry.pose.setOrigin(entry.pose.getOrigin().lerp(pose.getOrigin(), alpha));
+        entry.pose.setRotation(entry.pose.getRotation().slerp(pose.getRotation(), alpha));
+        entry.weight = std::min(entry.weight + 1, maxWeight_);
+        changed_.insert(obs.id);
+    }
+
+    return added;
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<int> MarkerMapper::takeChanges() {
+    std::vector<int> ids(changed_.begin(), changed_.end());
+    changed_.clear();
+    return ids;
+}
+
+// ----------------------------------------------------------------------------
+
+aruco::MarkerMap MarkerMapper::toMarkerMap(const std::string& dictionary) const {
+    aruco::MarkerMap map;
+    map.mInfoType = aruco::MarkerMap::METERS;
+    map.setDictionary(dictionary);
+
+    for (const auto& marker : markers_) {
+        aruco::Marker3DInfo info(marker.first);
+        std::vector<cv::Point3f> points = corners(marker.second.pose, markerSize_);
+        info.assign(points.begin(), points.end());
+        map.push_back(info);
+    }
+
+    return map;
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<cv::Point3f> MarkerMapper::corners(const tf::Transform& pose, double size) {
+    const double h = size / 2;
+    const tf::Vector3 local[4] = { tf::Vector3(-h, h, 0), tf::Vector3(h, h, 0), tf::Vector3(h, -h, 0), tf::Vector3(-h, -h, 0) };
+
+    std::vector<cv::Point3f> points;
+    for (const tf::Vector3& p : local) {
+        tf::Vector3 q = pose * p;
+        points.push_back(cv::Point3f(q.x(), q.y(), q.z()));
+    }
+
+    return points;
+}
+
+}
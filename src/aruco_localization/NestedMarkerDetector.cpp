@@ -0,0 +1,98 @@
+#include "aruco_localization/NestedMarkerDetector.h"
+
+#include <algorithm>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+NestedMarkerDetector::NestedMarkerDetector() :
+    decimation_(4), minInnerPerimeter_(400)
+{}
+
+// ----------------------------------------------------------------------------
+
+size_t NestedMarkerDetector::load(const std::string& file) {
+    inner_.clear();
+
+    cv::FileStorage fs(file, cv::FileStorage::READ);
+    if (!fs.isOpened()) return 0;
+
+    cv::FileNode layouts = fs["nested_markers"];
+    for (size_t i=0; i<layouts.size(); ++i) {
+        cv::FileNode inner = layouts[i]["inner"];
+
+        std::vector<int>& ids = inner_[(int)layouts[i]["outer"]];
+        for (size_t j=0; j<inner.size(); ++j)
+            ids.push_back((int)inner[j]);
+    }
+
+    return inner_.size();
+}
+
+// ----------------------------------------------------------------------------
+
+void NestedMarkerDetector::detect(const cv::Mat& frame, DetectorBackend& detector, std::vector<aruco::Marker>& markers) {
+
+    //
+    // Coarse pass: find the outer markers (and close-by inner ones) on a small frame
+    //
+
+    cv::resize(frame, small_, cv::Size(frame.cols/decimation_, frame.rows/decimation_), 0, 0, cv::INTER_AREA);
+    detector.detect(small_, markers);
+
+    // Without an outer marker in view, the coarse pass may well have missed
+    // smaller markers that are not part of a layout
+    bool outer = false;
+    for (const aruco::Marker& marker : markers)
+        outer = outer || inner_.count(marker.id) > 0;
+    if (!outer) {
+        detector.detect(frame, markers);
+        return;
+    }
+
+    // Back to full resolution pixel coordinates (pixel centers of an area decimation)
+    const float d = static_cast<float>(decimation_);
+    const cv::Point2f half(0.5f, 0.5f);
+    for (aruco::Marker& marker : markers) {
+        for (cv::Point2f& p : marker)
+            p = (p + half)*d - half;
+    }
+
+    //
+    // Fine pass: search the area covered by each large enough outer marker at full resolution
+    //
+
+    const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    const size_t coarse = markers.size();
+    for (size_t i=0; i<coarse; ++i) {
+        std::map<int, std::vector<int>>::const_iterator layout = inner_.find(markers[i].id);
+        if (layout == inner_.end()) continue;
+
+        // too far away for the inner markers to be decodable
+        if (markers[i].getPerimeter() < minInnerPerimeter_) continue;
+
+        // the outer marker's bounding box, padded a little for the LINES refinement
+        cv::Rect roi = cv::boundingRect(markers[i]);
+        int pad = std::max(roi.width, roi.height) / 10;
+        roi = cv::Rect(roi.x - pad, roi.y - pad, roi.width + 2*pad, roi.height + 2*pad) & bounds;
+
+        detector.detect(frame(roi), fine_);
+        for (aruco::Marker& fine : fine_) {
+            const std::vector<int>& ids = layout->second;
+            if (std::find(ids.begin(), ids.end(), fine.id) == ids.end()) continue;
+
+            for (cv::Point2f& p : fine)
+                p += cv::Point2f(roi.x, roi.y);
+
+            // A full resolution detection replaces a coarse one of the same marker
+            std::vector<aruco::Marker>::iterator it = std::find_if(markers.begin(), markers.end(),
+                    [&fine](const aruco::Marker& m) { return m.id == fine.id; });
+
+            if (it != markers.end()) *it = fine;
+            else markers.push_back(fine);
+        }
+    }
+}
+
+}
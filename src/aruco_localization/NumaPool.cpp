@@ -0,0 +1,165 @@
+#include "aruco_localization/NumaPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <errno.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace aruco_localizer {
+
+// Huge pages are 2 MiB on x86-64 and (with 4 KiB base pages) on ARM64
+static const size_t HUGE_PAGE = 2 << 20;
+
+// ----------------------------------------------------------------------------
+
+std::vector<NumaTopology::Node> NumaTopology::discover() {
+    std::vector<Node> nodes;
+
+    const char* root = "/sys/devices/system/node";
+    if (DIR* dir = opendir(root)) {
+        while (dirent* entry = readdir(dir)) {
+            int id;
+            if (std::sscanf(entry->d_name, "node%d", &id) != 1) continue;
+
+            std::ifstream file(std::string(root) + "/" + entry->d_name + "/cpulist");
+            std::string list;
+            if (!std::getline(file, list)) continue;
+
+            // Nodes with memory only (e.g., CXL or HBM) have no CPUs to run on
+            Node node;
+            node.id = id;
+            node.cpus = parseCpuList(list);
+            if (!node.cpus.empty()) nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+
+    if (nodes.empty()) {
+        Node node;
+        node.id = 0;
+        for (unsigned int cpu=0; cpu<std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            node.cpus.push_back(cpu);
+        nodes.push_back(node);
+    }
+
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+    return nodes;
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<int> NumaTopology::parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+
+    std::stringstream ranges(list);
+    for (std::string range; std::getline(ranges, range, ',');) {
+        int first, last;
+        int n = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (n < 1) continue;
+        if (n == 1) last = first;
+        for (int cpu=first; cpu<=last; ++cpu)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+// ----------------------------------------------------------------------------
+
+bool NumaTopology::bindThread(const Node& node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : node.cpus)
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+
+    // 0 is the calling thread (not the whole process)
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// ----------------------------------------------------------------------------
+
+FramePool::FramePool() :
+    map_(nullptr), mapSize_(0), base_(nullptr), slots_(0), slotBytes_(0), hugePages_(HUGEPAGES_NONE)
+{}
+
+// ----------------------------------------------------------------------------
+
+FramePool::~FramePool() {
+    if (map_) munmap(map_, mapSize_);
+}
+
+// ----------------------------------------------------------------------------
+
+void FramePool::create(size_t slots, size_t slotBytes, HugePages hugePages) {
+    if (map_) munmap(map_, mapSize_);
+    map_ = base_ = nullptr;
+
+    // Slots start on a page boundary, so that no page is shared by two slots
+    // (and possibly two nodes)
+    const size_t page = hugePages == HUGEPAGES_NONE ? sysconf(_SC_PAGESIZE) : HUGE_PAGE;
+    slotBytes = (slotBytes + page - 1) / page * page;
+    size_t size = std::max<size_t>(slots, 1) * slotBytes;
+
+    void* map = MAP_FAILED;
+    size_t mapSize = size;
+    if (hugePages == HUGEPAGES_EXPLICIT) {
+        map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (map == MAP_FAILED) hugePages = HUGEPAGES_TRANSPARENT;
+    }
+    if (map == MAP_FAILED) {
+        // Transparent huge pages only back aligned 2 MiB ranges, so the pool
+        // is aligned within a slightly larger mapping
+        if (hugePages == HUGEPAGES_TRANSPARENT) mapSize += HUGE_PAGE;
+        map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (map == MAP_FAILED)
+        throw std::runtime_error(std::string("Could not map the frame pool: ") + strerror(errno));
+
+    uint8_t* base = static_cast<uint8_t*>(map);
+    if (hugePages == HUGEPAGES_TRANSPARENT) {
+        base += (HUGE_PAGE - reinterpret_cast<uintptr_t>(base) % HUGE_PAGE) % HUGE_PAGE;
+
+        // Only a hint: without THP support the pool simply uses regular pages
+        if (madvise(base, size, MADV_HUGEPAGE) != 0)
+            hugePages = HUGEPAGES_NONE;
+    }
+
+    map_ = map;
+    mapSize_ = mapSize;
+    base_ = base;
+    slots_ = slots;
+    slotBytes_ = slotBytes;
+    hugePages_ = hugePages;
+}
+
+// ----------------------------------------------------------------------------
+
+void FramePool::touch(size_t index) {
+    // One write per base page is enough to fault it in
+    const size_t page = sysconf(_SC_PAGESIZE);
+    volatile uint8_t* p = slot(index);
+    for (size_t offset=0; offset<slotBytes_; offset+=page)
+        p[offset] = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+FramePool::HugePages FramePool::parseHugePages(const std::string& mode) {
+    if (mode == "none") return HUGEPAGES_NONE;
+    if (mode == "transparent") return HUGEPAGES_TRANSPARENT;
+    if (mode == "explicit") return HUGEPAGES_EXPLICIT;
+    throw std::runtime_error("Unknown huge page mode " + mode + " (none, transparent or explicit)");
+}
+
+// ----------------------------------------------------------------------------
+
+}
@@ -0,0 +1,165 @@
+#include "aruco_localization/PerfCounters.h"
+
+#include <algorithm>
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace aruco_localizer {
+
+#ifdef __linux__
+
+// perf_event_open has no glibc wrapper
+static int perfEventOpen(uint32_t type, uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    // user space only, which is what an unprivileged process may count
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // the whole group is started at once through the leader
+    attr.disabled = (group < 0) ? 1 : 0;
+
+    // this thread, on any CPU
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+PerfCounters::PerfCounters() :
+    leader_(-1), numSlots_(0)
+{
+    for (int i=0; i<NUM_EVENTS; ++i) {
+        fds_[i] = -1;
+        slot_[i] = -1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+// ----------------------------------------------------------------------------
+
+bool PerfCounters::open() {
+    close();
+
+#ifdef __linux__
+    static const uint64_t configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (int i=0; i<NUM_EVENTS; ++i) {
+        fds_[i] = perfEventOpen(PERF_TYPE_HARDWARE, configs[i], leader_);
+
+        if (fds_[i] < 0) {
+            // Without cycles there is nothing to report. Other events may
+            // legitimately be missing on some CPUs, those just read zero.
+            if (i == CYCLES) {
+                error_ = strerror(errno);
+                return false;
+            }
+            continue;
+        }
+
+        if (leader_ < 0) leader_ = fds_[i];
+        slot_[i] = numSlots_++;
+    }
+
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    error_ = "perf_event_open is only available on Linux";
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+void PerfCounters::close() {
+#ifdef __linux__
+    for (int i=0; i<NUM_EVENTS; ++i)
+        if (fds_[i] >= 0) ::close(fds_[i]);
+#endif
+
+    leader_ = -1;
+    numSlots_ = 0;
+    for (int i=0; i<NUM_EVENTS; ++i) {
+        fds_[i] = -1;
+        slot_[i] = -1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void PerfCounters::read(uint64_t values[NUM_EVENTS]) const {
+    for (int i=0; i<NUM_EVENTS; ++i) values[i] = 0;
+
+#ifdef __linux__
+    if (leader_ < 0) return;
+
+    // PERF_FORMAT_GROUP: { nr, values[nr] }
+    uint64_t buffer[1 + NUM_EVENTS];
+    if (::read(leader_, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t)) return;
+
+    for (int i=0; i<NUM_EVENTS; ++i)
+        if (slot_[i] >= 0 && slot_[i] < (int)buffer[0]) values[i] = buffer[1 + slot_[i]];
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// StageCounters
+// ----------------------------------------------------------------------------
+
+StageCounters::StageCounters(const std::vector<std::string>& stages) :
+    stages_(stages),
+    start_(stages.size()*PerfCounters::NUM_EVENTS, 0),
+    totals_(stages.size()*PerfCounters::NUM_EVENTS, 0)
+{}
+
+// ----------------------------------------------------------------------------
+
+void StageCounters::begin(int stage) {
+    if (!counters_.isOpen()) return;
+    counters_.read(&start_[stage*PerfCounters::NUM_EVENTS]);
+}
+
+// ----------------------------------------------------------------------------
+
+void StageCounters::end(int stage) {
+    if (!counters_.isOpen()) return;
+
+    uint64_t now[PerfCounters::NUM_EVENTS];
+    counters_.read(now);
+
+    for (int i=0; i<PerfCounters::NUM_EVENTS; ++i) {
+        int idx = stage*PerfCounters::NUM_EVENTS + i;
+        totals_[idx] += now[i] - start_[idx];
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void StageCounters::reset() {
+    std::fill(totals_.begin(), totals_.end(), 0);
+}
+
+}
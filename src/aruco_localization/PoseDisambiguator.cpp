@@ -0,0 +1,96 @@
+#include "aruco_localization/PoseDisambiguator.h"
+
+#include <aruco/ippe.h>
+
+#include <algorithm>
+
+namespace aruco_localizer {
+
+// Angle of the rotation between two rotation matrices
+static double rotationAngle(const cv::Matx33d& Ra, const cv::Matx33d& Rb) {
+    cv::Matx33d dR = Ra.t() * Rb;
+    double c = (dR(0,0) + dR(1,1) + dR(2,2) - 1.0) / 2.0;
+    return std::acos(std::min(1.0, std::max(-1.0, c)));
+}
+
+// ----------------------------------------------------------------------------
+
+PoseDisambiguator::PoseDisambiguator() :
+    minErrorRatio_(4.0), flipAngle_(30.0*M_PI/180.0), maxGap_(10), frame_(0)
+{}
+
+// ----------------------------------------------------------------------------
+
+bool PoseDisambiguator::solve(const cv::Point2f* corners, float markerSize,
+                              const aruco::CameraParameters& camParams, Candidates& candidates)
+{
+    // IPPE takes the corners as a vector, which is kept per thread
+    static thread_local std::vector<cv::Point2f> points(4);
+    std::copy(corners, corners + 4, points.begin());
+
+    // IPPE returns both solutions (as 4x4 RT matrices) with their reprojection errors
+    std::vector<std::pair<cv::Mat, double>> solutions =
+            aruco::solvePnP_(markerSize, points, camParams.CameraMatrix, camParams.Distorsion);
+    if (solutions.size() != 2) return false;
+
+    if (solutions[1].second < solutions[0].second)
+        std::swap(solutions[0], solutions[1]);
+
+    for (int i=0; i<2; ++i) {
+        // Converted into fixed-size matrices, in place
+        cv::Matx44d RT;
+        cv::Mat RTview(4, 4, CV_64FC1, RT.val);
+        solutions[i].first.convertTo(RTview, CV_64FC1);
+
+        cv::Vec3d rvec;
+        cv::Rodrigues(RT.get_minor<3, 3>(0, 0), rvec);
+
+        Candidate& c = candidates.c[i];
+        c.rvec = cv::Vec3f(rvec[0], rvec[1], rvec[2]);
+        c.tvec = cv::Vec3f(RT(0, 3), RT(1, 3), RT(2, 3));
+        c.error = solutions[i].second;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+bool PoseDisambiguator::select(int id, const Candidates& candidates, cv::Vec3f& rvec, cv::Vec3f& tvec, float& error) {
+
+    cv::Matx33d R[2];
+    for (int i=0; i<2; ++i) {
+        const cv::Vec3f& r = candidates.c[i].rvec;
+        cv::Rodrigues(cv::Vec3d(r[0], r[1], r[2]), R[i]);
+    }
+
+    // Is there a recent enough pose of this marker to compare against?
+    std::map<int, Track>::iterator track = tracks_.find(id);
+    bool hasPrevious = track != tracks_.end() && frame_ - track->second.frame <= maxGap_;
+
+    // By default, trust the lowest reprojection error
+    int best = 0;
+
+    // If the reprojection errors are too close to call, use the solution
+    // that is closest to where this marker was in the previous frame.
+    double ratio = candidates.c[1].error / std::max(candidates.c[0].error, 1e-9);
+    if (ratio < minErrorRatio_ && hasPrevious) {
+        if (rotationAngle(track->second.R, R[1]) < rotationAngle(track->second.R, R[0]))
+            best = 1;
+    }
+
+    // Whatever was chosen, a large jump w.r.t. the previous frame is a flip
+    bool flipped = hasPrevious && rotationAngle(track->second.R, R[best]) > flipAngle_;
+
+    rvec = candidates.c[best].rvec;
+    tvec = candidates.c[best].tvec;
+    error = static_cast<float>(candidates.c[best].error);
+
+    Track& t = tracks_[id];
+    t.R = R[best];
+    t.frame = frame_;
+
+    return flipped;
+}
+
+}
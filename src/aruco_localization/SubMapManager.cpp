@@ -0,0 +1,260 @@
+#include "aruco_localization/SubMapManager.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include <ros/ros.h>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+SubMapManager::SubMapManager() :
+    markerSize_(0), margin_(1.0), active_(-1), poseMarkerSize_(0)
+{}
+
+// ----------------------------------------------------------------------------
+
+void SubMapManager::load(const std::string& configFile, float markerSize) {
+    markerSize_ = markerSize;
+    poseMarkerSize_ = markerSize;
+
+    cv::FileStorage fs(configFile, cv::FileStorage::READ);
+    if (!fs.isOpened())
+        throw cv::Exception(-1, "Could not open " + configFile, "SubMapManager::load", __FILE__, __LINE__);
+
+    // Map files are relative to the directory of the config file
+    std::string dir = configFile.substr(0, configFile.find_last_of('/') + 1);
+
+    cv::FileNode submaps = fs["submaps"];
+    zones_.resize(submaps.size());
+
+    std::map<std::string, int> index;
+    std::vector<std::vector<std::string>> neighborNames(zones_.size());
+    for (size_t i=0; i<zones_.size(); ++i) {
+        cv::FileNode node = submaps[i];
+
+        zones_[i].name = (std::string)node["name"];
+        zones_[i].file = (std::string)node["markermap"];
+        if (!zones_[i].file.empty() && zones_[i].file[0] != '/')
+            zones_[i].file = dir + zones_[i].file;
+
+        cv::FileNode neighbors = node["neighbors"];
+        for (size_t j=0; j<neighbors.size(); ++j)
+            neighborNames[i].push_back((std::string)neighbors[j]);
+
+        index[zones_[i].name] = i;
+    }
+
+    for (size_t i=0; i<zones_.size(); ++i) {
+        Zone& zone = zones_[i];
+
+        for (const std::string& name : neighborNames[i]) {
+            if (index.count(name)) zone.neighbors.push_back(index[name]);
+            else ROS_WARN("[aruco] Unknown neighbor '%s' of zone '%s'", name.c_str(), zone.name.c_str());
+        }
+
+        // Read each map once to index its marker IDs and bounds. Only
+        // this small index stays in memory, the map itself is paged out.
+        std::shared_ptr<aruco::MarkerMap> map = readMap(zone.file, markerSize_);
+
+        if (dictionary_.empty())
+            dictionary_ = map->getDictionary();
+
+        zone.min = cv::Point3f( FLT_MAX,  FLT_MAX,  FLT_MAX);
+        zone.max = cv::Point3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (const aruco::Marker3DInfo& info : *map) {
+            zonesOfMarker_[info.id].push_back(i);
+
+            for (const cv::Point3f& p : info) {
+                zone.min = cv::Point3f(std::min(zone.min.x, p.x), std::min(zone.min.y, p.y), std::min(zone.min.z, p.z));
+                zone.max = cv::Point3f(std::max(zone.max.x, p.x), std::max(zone.max.y, p.y), std::max(zone.max.z, p.z));
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void SubMapManager::setCameraParams(const aruco::CameraParameters& camParams) {
+    camParams_ = camParams;
+
+    // Zones that were paged in before the camera was known
+    for (Zone& zone : zones_) {
+        if (zone.map && !zone.tracker) {
+            zone.tracker.reset(new aruco::MarkerMapPoseTracker);
+            zone.tracker->setParams(camParams_, *zone.map);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool SubMapManager::estimatePose(const std::vector<aruco::Marker>& markers) {
+    collect();
+
+    // (Re)localize if none of the detected markers belong to the loaded zones,
+    // e.g., at startup or after being carried somewhere else
+    int zone = relocalize(markers);
+    if (zone >= 0 && !isWanted(zone)) {
+        active_ = zone;
+        page();
+    }
+
+    if (active_ < 0) return false;
+
+    // Try the active zone first, then its neighbors
+    int found = -1;
+    if (tryZone(active_, markers)) {
+        found = active_;
+    } else {
+        for (int n : zones_[active_].neighbors)
+            if (tryZone(n, markers)) { found = n; break; }
+    }
+
+    if (found < 0) return false;
+
+    rvec_ = zones_[found].tracker->getRvec();
+    tvec_ = zones_[found].tracker->getTvec();
+
+    // Kept here, as the zone may be paged out by the switch below
+    const std::shared_ptr<aruco::MarkerMap>& map = zones_[found].map;
+    poseMarkerSize_ = map->empty() ? markerSize_ : (*map)[0].getMarkerSize();
+
+    // Camera position in the site frame
+    cv::Mat R, rvec64, tvec64;
+    rvec_.convertTo(rvec64, CV_64FC1);
+    tvec_.convertTo(tvec64, CV_64FC1);
+    cv::Rodrigues(rvec64, R);
+    cv::Mat p = -R.t() * tvec64;
+    cv::Point3f position(p.at<double>(0), p.at<double>(1), p.at<double>(2));
+
+    // Switch zones if the camera has left the zone that produced the pose
+    int next = found;
+    if (!contains(found, position)) {
+        for (int n : zones_[found].neighbors)
+            if (contains(n, position)) { next = n; break; }
+    }
+
+    if (next != active_) {
+        ROS_INFO("[aruco] Switching from zone '%s' to '%s'", zones_[active_].name.c_str(), zones_[next].name.c_str());
+        active_ = next;
+        page();
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+std::string SubMapManager::getActiveZone() const {
+    return (active_ < 0) ? "" : zones_[active_].name;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+std::shared_ptr<aruco::MarkerMap> SubMapManager::readMap(const std::string& file, float markerSize) {
+    std::shared_ptr<aruco::MarkerMap> map(new aruco::MarkerMap);
+    map->readFromFile(file);
+
+    if (map->isExpressedInPixels())
+        *map = map->convertToMeters(markerSize);
+
+    return map;
+}
+
+// ----------------------------------------------------------------------------
+
+void SubMapManager::page() {
+    for (size_t i=0; i<zones_.size(); ++i) {
+        Zone& zone = zones_[i];
+
+        if (isWanted(i)) {
+            // Load in the background, unless it's already there or on its way
+            if (!zone.map && !zone.pending.valid())
+                zone.pending = std::async(std::launch::async, &SubMapManager::readMap, zone.file, markerSize_);
+        } else {
+            zone.tracker.reset();
+            zone.map.reset();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void SubMapManager::collect() {
+    for (size_t i=0; i<zones_.size(); ++i) {
+        Zone& zone = zones_[i];
+
+        if (!zone.pending.valid() ||
+                zone.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            continue;
+
+        std::shared_ptr<aruco::MarkerMap> map;
+        try {
+            map = zone.pending.get();
+        } catch (cv::Exception& e) {
+            ROS_ERROR("[aruco] Could not load zone '%s': %s", zone.name.c_str(), e.what());
+            continue;
+        }
+
+        // The camera may have moved on while this zone was loading
+        if (!isWanted(i)) continue;
+
+        zone.map = map;
+        if (camParams_.isValid()) {
+            zone.tracker.reset(new aruco::MarkerMapPoseTracker);
+            zone.tracker->setParams(camParams_, *zone.map);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool SubMapManager::isWanted(int zone) const {
+    if (active_ < 0) return false;
+    if (zone == active_) return true;
+
+    const std::vector<int>& n = zones_[active_].neighbors;
+    return std::find(n.begin(), n.end(), zone) != n.end();
+}
+
+// ----------------------------------------------------------------------------
+
+bool SubMapManager::tryZone(int zone, const std::vector<aruco::Marker>& markers) {
+    const std::unique_ptr<aruco::MarkerMapPoseTracker>& tracker = zones_[zone].tracker;
+    return tracker && tracker->isValid() && tracker->estimatePose(markers);
+}
+
+// ----------------------------------------------------------------------------
+
+bool SubMapManager::contains(int zone, const cv::Point3f& p) const {
+    const Zone& z = zones_[zone];
+    return p.x >= z.min.x - margin_ && p.x <= z.max.x + margin_ &&
+           p.y >= z.min.y - margin_ && p.y <= z.max.y + margin_ &&
+           p.z >= z.min.z - margin_ && p.z <= z.max.z + margin_;
+}
+
+// ----------------------------------------------------------------------------
+
+int SubMapManager::relocalize(const std::vector<aruco::Marker>& markers) const {
+    std::vector<int> votes(zones_.size(), 0);
+
+    for (const aruco::Marker& marker : markers) {
+        std::map<int, std::vector<int>>::const_iterator it = zonesOfMarker_.find(marker.id);
+        if (it == zonesOfMarker_.end()) continue;
+
+        for (int zone : it->second) {
+            // A marker of a loaded zone means that there's nothing to do
+            if (isWanted(zone)) return -1;
+            votes[zone]++;
+        }
+    }
+
+    int best = std::max_element(votes.begin(), votes.end()) - votes.begin();
+    return (votes.empty() || votes[best] == 0) ? -1 : best;
+}
+
+}
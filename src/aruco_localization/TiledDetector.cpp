@@ -0,0 +1,205 @@
+#include "aruco_localization/TiledDetector.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace aruco_localizer {
+
+// ----------------------------------------------------------------------------
+
+MappedImage::MappedImage() :
+    fd_(-1), map_(nullptr), mapSize_(0), pixels_(nullptr), width_(0), height_(0), released_(0)
+{}
+
+// ----------------------------------------------------------------------------
+
+MappedImage::~MappedImage() {
+    close();
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedImage::open(const std::string& file, int width, int height) {
+    close();
+
+    fd_ = ::open(file.c_str(), O_RDONLY);
+    if (fd_ < 0) throw std::runtime_error("Could not open " + file);
+
+    struct stat st;
+    fstat(fd_, &st);
+    mapSize_ = st.st_size;
+
+    // Binary PGM: "P5 <width> <height> <maxval>" followed by a single whitespace
+    size_t offset = 0;
+    std::ifstream header(file.c_str(), std::ios::binary);
+    std::string magic;
+    header >> magic;
+    if (magic == "P5") {
+        int values[3], n = 0;
+        while (n < 3 && header) {
+            header >> std::ws;
+            if (header.peek() == '#') { std::string comment; std::getline(header, comment); continue; }
+            header >> values[n++];
+        }
+        if (n < 3 || values[2] > 255) throw std::runtime_error(file + " is not an 8 bit PGM");
+
+        width = values[0];
+        height = values[1];
+        offset = static_cast<size_t>(header.tellg()) + 1;
+    }
+
+    if (width <= 0 || height <= 0 || offset + static_cast<size_t>(width)*height > mapSize_)
+        throw std::runtime_error("The size of " + file + " is unknown or does not match its contents");
+
+    void* map = mmap(nullptr, mapSize_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) throw std::runtime_error("Could not map " + file);
+
+    map_ = static_cast<uint8_t*>(map);
+    pixels_ = map_ + offset;
+    width_ = width;
+    height_ = height;
+    released_ = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedImage::close() {
+    if (map_) munmap(map_, mapSize_);
+    if (fd_ >= 0) ::close(fd_);
+
+    fd_ = -1;
+    map_ = nullptr;
+    pixels_ = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedImage::read(const cv::Rect& roi, cv::Mat& out) const {
+    cv::Mat src(roi.height, roi.width, CV_8UC1, const_cast<uint8_t*>(pixels_ + static_cast<size_t>(roi.y)*width_ + roi.x), width_);
+    src.copyTo(out);
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedImage::release(int row) {
+    row = std::min(row, height_);
+
+    // madvise works on whole pages
+    const size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = (pixels_ - map_) + static_cast<size_t>(released_)*width_;
+    size_t end = (pixels_ - map_) + static_cast<size_t>(row)*width_;
+
+    begin = (begin + page - 1) / page * page;
+    end = end / page * page;
+    if (end > begin)
+        madvise(map_ + begin, end - begin, MADV_DONTNEED);
+
+    released_ = std::max(released_, row);
+}
+
+// ----------------------------------------------------------------------------
+// TiledDetector
+// ----------------------------------------------------------------------------
+
+TiledDetector::TiledDetector() :
+    dictionary_("ARUCO_MIP_36h12"), tileSize_(2048), overlap_(256)
+{}
+
+// ----------------------------------------------------------------------------
+
+std::vector<TiledDetector::Detection> TiledDetector::detect(MappedImage& image, Executor& executor) {
+    std::vector<Detection> detections;
+    std::mutex detectionsMutex;
+
+    const int stride = std::max(1, tileSize_ - overlap_);
+    const int half = overlap_ / 2;
+
+    for (int y=0; y<image.height(); y+=stride) {
+        int h = std::min(tileSize_, image.height() - y);
+
+        std::vector<int> xs;
+        for (int x=0; x<image.width(); x+=stride) {
+            xs.push_back(x);
+            if (x + tileSize_ >= image.width()) break;
+        }
+
+        executor.parallelFor(xs.size(), [&](size_t i) {
+            cv::Rect tile(xs[i], y, std::min(tileSize_, image.width() - xs[i]), h);
+
+            // Every pixel belongs to the core of exactly one tile: the tile minus
+            // half of the overlap on each side that has a neighbor. A marker is
+            // only reported by the tile whose core holds its center.
+            cv::Rect core(tile.x + (tile.x > 0 ? half : 0), tile.y + (tile.y > 0 ? half : 0), 0, 0);
+            core.width = (tile.x + tile.width >= image.width() ? tile.x + tile.width : tile.x + tile.width - (overlap_ - half)) - core.x;
+            core.height = (tile.y + tile.height >= image.height() ? tile.y + tile.height : tile.y + tile.height - (overlap_ - half)) - core.y;
+
+            Slot* slot = acquire();
+            image.read(tile, slot->tile);
+            std::vector<aruco::Marker> markers = slot->detector.detect(slot->tile);
+            release(slot);
+
+            for (const aruco::Marker& marker : markers) {
+                cv::Point2f center = marker.getCenter() + cv::Point2f(tile.x, tile.y);
+                if (center.x < core.x || center.x >= core.x + core.width ||
+                    center.y < core.y || center.y >= core.y + core.height)
+                    continue;
+
+                Detection d;
+                d.id = marker.id;
+                for (int k=0; k<4; ++k)
+                    d.corners[k] = marker[k] + cv::Point2f(tile.x, tile.y);
+
+                std::lock_guard<std::mutex> lock(detectionsMutex);
+                detections.push_back(d);
+            }
+        }, Executor::Clock::now());
+
+        // The next strip starts at y + stride, nothing above it is needed anymore
+        image.release(y + stride);
+
+        if (y + tileSize_ >= image.height()) break;
+    }
+
+    // The order in which tiles finish is not deterministic, the output is
+    std::sort(detections.begin(), detections.end(), [](const Detection& a, const Detection& b) {
+        if (a.id != b.id) return a.id < b.id;
+        if (a.corners[0].y != b.corners[0].y) return a.corners[0].y < b.corners[0].y;
+        return a.corners[0].x < b.corners[0].x;
+    });
+
+    return detections;
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+TiledDetector::Slot* TiledDetector::acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (free_.empty()) {
+        Slot* slot = new Slot;
+        slot->detector.setDictionary(dictionary_);
+        slot->detector.setCornerRefinementMethod(aruco::MarkerDetector::LINES);
+        return slot;
+    }
+
+    Slot* slot = free_.back().release();
+    free_.pop_back();
+    return slot;
+}
+
+// ----------------------------------------------------------------------------
+
+void TiledDetector::release(Slot* slot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.emplace_back(slot);
+}
+
+}
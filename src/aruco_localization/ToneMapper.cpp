@@ -0,0 +1,92 @@
+#include "aruco_localization/ToneMapper.h"
+
+namespace aruco_localizer {
+
+// The histogram has 4096 bins, i.e., the 4 LSBs of the input are ignored
+static const int HIST_SHIFT = 4;
+
+// Only every SAMPLE_STRIDE-th pixel of every SAMPLE_STRIDE-th row is histogrammed
+static const int SAMPLE_STRIDE = 4;
+
+// ----------------------------------------------------------------------------
+
+ToneMapper::ToneMapper() :
+    clipFraction_(0.005), gamma_(2.0), lo_(-1), hi_(-1),
+    lut_(1 << 16), hist_(1 << (16 - HIST_SHIFT))
+{}
+
+// ----------------------------------------------------------------------------
+
+void ToneMapper::apply(const cv::Mat& in, cv::Mat& out) {
+    CV_Assert(in.type() == CV_16UC1);
+
+    int lo, hi;
+    findRange(in, lo, hi);
+
+    // Only rebuild the table if the range moved by more than a few percent,
+    // which also keeps the output brightness from flickering
+    const int hysteresis = std::max(1, (hi_ - lo_) / 32);
+    if (lo_ < 0 || std::abs(lo - lo_) > hysteresis || std::abs(hi - hi_) > hysteresis)
+        buildLut(lo, hi);
+
+    out.create(in.size(), CV_8UC1);
+
+    const uint8_t* lut = lut_.data();
+    for (int r=0; r<in.rows; ++r) {
+        const uint16_t* src = in.ptr<uint16_t>(r);
+        uint8_t* dst = out.ptr<uint8_t>(r);
+
+        // unrolled so that the independent table loads can be overlapped
+        int c = 0;
+        for (; c<=in.cols-4; c+=4) {
+            dst[c]   = lut[src[c]];
+            dst[c+1] = lut[src[c+1]];
+            dst[c+2] = lut[src[c+2]];
+            dst[c+3] = lut[src[c+3]];
+        }
+        for (; c<in.cols; ++c)
+            dst[c] = lut[src[c]];
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Private Methods
+// ----------------------------------------------------------------------------
+
+void ToneMapper::findRange(const cv::Mat& in, int& lo, int& hi) {
+    std::fill(hist_.begin(), hist_.end(), 0);
+
+    uint32_t n = 0;
+    for (int r=0; r<in.rows; r+=SAMPLE_STRIDE) {
+        const uint16_t* src = in.ptr<uint16_t>(r);
+        for (int c=0; c<in.cols; c+=SAMPLE_STRIDE, ++n)
+            hist_[src[c] >> HIST_SHIFT]++;
+    }
+
+    // Walk the histogram from both ends until the clip fraction is reached
+    const uint32_t clip = static_cast<uint32_t>(clipFraction_*n);
+
+    int lbin = 0;
+    for (uint32_t acc=0; lbin<(int)hist_.size()-1 && (acc += hist_[lbin]) <= clip; ++lbin);
+
+    int hbin = hist_.size() - 1;
+    for (uint32_t acc=0; hbin>lbin && (acc += hist_[hbin]) <= clip; --hbin);
+
+    lo = lbin << HIST_SHIFT;
+    hi = ((hbin + 1) << HIST_SHIFT) - 1;
+}
+
+// ----------------------------------------------------------------------------
+
+void ToneMapper::buildLut(int lo, int hi) {
+    lo_ = lo;
+    hi_ = hi;
+
+    const double scale = 1.0 / std::max(1, hi - lo);
+    for (int v=0; v<(int)lut_.size(); ++v) {
+        double t = std::min(1.0, std::max(0.0, (v - lo)*scale));
+        lut_[v] = cv::saturate_cast<uint8_t>(255.0*std::pow(t, 1.0/gamma_));
+    }
+}
+
+}
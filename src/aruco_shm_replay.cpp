@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "aruco_localization/FrameRing.h"
+
+// Replays a video (or an image sequence such as `frames/%06d.png`) into a
+// shared memory frame ring, for the localizer to read with `frame_source: shm`.
+//
+// Usage: aruco_shm_replay <video|pattern> [--name /aruco_frames] [--fps 30]
+//            [--slots 4] [--loop 0]
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <video|pattern> [--name /aruco_frames] [--fps 30]"
+                  << " [--slots 4] [--loop 0]" << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::string> args;
+    for (int i=2; i+1<argc; i+=2)
+        args[argv[i]] = argv[i+1];
+
+    auto arg = [&args](const std::string& key, const std::string& def) {
+        return args.count(key) ? args[key] : def;
+    };
+
+    const std::string name = arg("--name", "/aruco_frames");
+    const double fps = std::atof(arg("--fps", "30").c_str());
+    const int slots = std::atoi(arg("--slots", "4").c_str());
+    const bool loop = std::atoi(arg("--loop", "0").c_str()) != 0;
+
+    aruco_localizer::FrameRing ring;
+    uint64_t published = 0, dropped = 0;
+
+    do {
+        cv::VideoCapture capture(argv[1]);
+        if (!capture.isOpened()) {
+            std::cerr << "Could not open " << argv[1] << std::endl;
+            return 1;
+        }
+
+        auto next = std::chrono::steady_clock::now();
+        cv::Mat frame;
+        while (capture.read(frame)) {
+            if (!frame.isContinuous())
+                frame = frame.clone();
+
+            // The ring is sized for the first frame
+            if (!ring.isOpen()) {
+                try {
+                    ring.create(name, slots, frame.total() * frame.elemSize());
+                } catch (std::exception& e) {
+                    std::cerr << e.what() << std::endl;
+                    return 1;
+                }
+            }
+
+            uint64_t stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+            if (ring.publish(frame.data, frame.cols, frame.rows, frame.step, frame.type(), frame.elemSize(), stamp))
+                ++published;
+            else
+                ++dropped;
+
+            if (fps > 0) {
+                next += std::chrono::nanoseconds(static_cast<int64_t>(1e9 / fps));
+                std::this_thread::sleep_until(next);
+            }
+        }
+    } while (loop);
+
+    std::cerr << published << " frames published, " << dropped << " dropped, "
+              << ring.skipped() << " slots skipped while being read" << std::endl;
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "aruco_localization/TiledDetector.h"
+
+// Offline detection of markers in images that are too large to load, e.g.,
+// orthomosaics with markers as ground control points.
+//
+// Usage: aruco_tile_detect <image.pgm|image.raw> [--width W --height H]
+//            [--dictionary ARUCO_MIP_36h12] [--tile 2048] [--overlap 256]
+//            [--threads 0] [--output detections.csv]
+//
+// Writes one line per marker: id,x0,y0,x1,y1,x2,y2,x3,y3 (image pixels)
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <image.pgm|image.raw> [--width W --height H] [--dictionary D]"
+                  << " [--tile 2048] [--overlap 256] [--threads 0] [--output file.csv]" << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::string> args;
+    for (int i=2; i+1<argc; i+=2)
+        args[argv[i]] = argv[i+1];
+
+    auto arg = [&args](const std::string& key, const std::string& def) {
+        return args.count(key) ? args[key] : def;
+    };
+
+    aruco_localizer::MappedImage image;
+    try {
+        image.open(argv[1], std::atoi(arg("--width", "0").c_str()), std::atoi(arg("--height", "0").c_str()));
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    aruco_localizer::TiledDetector detector;
+    detector.setDictionary(arg("--dictionary", "ARUCO_MIP_36h12"));
+    detector.setTileSize(std::atoi(arg("--tile", "2048").c_str()));
+    detector.setOverlap(std::atoi(arg("--overlap", "256").c_str()));
+
+    aruco_localizer::Executor& executor = aruco_localizer::Executor::instance(std::atoi(arg("--threads", "0").c_str()));
+    std::vector<aruco_localizer::TiledDetector::Detection> detections = detector.detect(image, executor);
+
+    std::string output = arg("--output", "");
+    FILE* out = output.empty() ? stdout : std::fopen(output.c_str(), "w");
+    if (!out) {
+        std::cerr << "Could not open " << output << std::endl;
+        return 1;
+    }
+
+    for (const auto& d : detections) {
+        std::fprintf(out, "%d", d.id);
+        for (int k=0; k<4; ++k)
+            std::fprintf(out, ",%.2f,%.2f", d.corners[k].x, d.corners[k].y);
+        std::fprintf(out, "\n");
+    }
+
+    if (out != stdout) std::fclose(out);
+
+    std::cerr << detections.size() << " markers in " << image.width() << "x" << image.height() << std::endl;
+    return 0;
+}